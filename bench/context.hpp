@@ -0,0 +1,156 @@
+
+// Copyright Ricardo Calheiros de Miranda Cosme 2017.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <glad/glad.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <chrono>
+#include <stdexcept>
+
+namespace freijo { namespace bench {
+
+/// Headless OpenGL context to run the benchmarks without a window
+///
+/// It uses the surfaceless platform of EGL (EGL_MESA_platform_surfaceless),
+/// so it runs on a CI box with Mesa llvmpipe. There is no default
+/// framebuffer, then a small framebuffer object is bound as the
+/// render target.
+///
+class context
+{
+public:
+    explicit context(int major = 4, int minor = 5,
+                     GLsizei width = 256, GLsizei height = 256)
+        : _width(width)
+        , _height(height)
+    {
+        auto getPlatformDisplay =
+            reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>
+            (eglGetProcAddress("eglGetPlatformDisplayEXT"));
+        if(!getPlatformDisplay)
+            throw std::runtime_error("eglGetPlatformDisplayEXT not found");
+
+        _display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                      EGL_DEFAULT_DISPLAY, nullptr);
+        if(!eglInitialize(_display, nullptr, nullptr))
+            throw std::runtime_error("Failed to initialize EGL");
+
+        eglBindAPI(EGL_OPENGL_API);
+        const EGLint attribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, major,
+            EGL_CONTEXT_MINOR_VERSION, minor,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK,
+            EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        _context = eglCreateContext(_display, EGL_NO_CONFIG_KHR,
+                                    EGL_NO_CONTEXT, attribs);
+        if(_context == EGL_NO_CONTEXT)
+            throw std::runtime_error("Failed to create the EGL context");
+
+        eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE, _context);
+        if(!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+            throw std::runtime_error("Failed to initialize GLAD");
+
+        glGenRenderbuffers(1, &_rbo);
+        glBindRenderbuffer(GL_RENDERBUFFER, _rbo);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, _width, _height);
+        glGenFramebuffers(1, &_fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                  GL_RENDERBUFFER, _rbo);
+        glViewport(0, 0, _width, _height);
+    }
+
+    ~context()
+    {
+        glDeleteFramebuffers(1, &_fbo);
+        glDeleteRenderbuffers(1, &_rbo);
+        eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                       EGL_NO_CONTEXT);
+        eglDestroyContext(_display, _context);
+        eglTerminate(_display);
+    }
+
+    context(const context&) = delete;
+    context& operator=(const context&) = delete;
+
+    GLsizei width() const noexcept { return _width; }
+    GLsizei height() const noexcept { return _height; }
+
+    EGLDisplay display() const noexcept { return _display; }
+    EGLContext handle() const noexcept { return _context; }
+private:
+    GLsizei _width;
+    GLsizei _height;
+    EGLDisplay _display{EGL_NO_DISPLAY};
+    EGLContext _context{EGL_NO_CONTEXT};
+    GLuint _fbo{0};
+    GLuint _rbo{0};
+};
+
+/// Context that shares the objects of a context, to be made current
+/// in another thread
+class shared_context
+{
+public:
+    explicit shared_context(const context& ctx, int major = 4, int minor = 5)
+        : _display(ctx.display())
+    {
+        const EGLint attribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, major,
+            EGL_CONTEXT_MINOR_VERSION, minor,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK,
+            EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        _context = eglCreateContext(_display, EGL_NO_CONFIG_KHR,
+                                    ctx.handle(), attribs);
+        if(_context == EGL_NO_CONTEXT)
+            throw std::runtime_error("Failed to create the shared context");
+    }
+
+    ~shared_context()
+    { eglDestroyContext(_display, _context); }
+
+    shared_context(const shared_context&) = delete;
+    shared_context& operator=(const shared_context&) = delete;
+
+    /// Make the context current in the calling thread
+    void make_current() const
+    { eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE, _context); }
+
+    /// Release the context from the calling thread
+    void release() const
+    {
+        eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                       EGL_NO_CONTEXT);
+    }
+private:
+    EGLDisplay _display;
+    EGLContext _context;
+};
+
+/// Return the average time in milliseconds of `iterations` calls to
+/// `f`. The pipeline is drained(glFinish) before and after the
+/// measurement.
+template<typename F>
+double time_ms(F&& f, std::size_t iterations)
+{
+    using clock = std::chrono::steady_clock;
+    glFinish();
+    auto start = clock::now();
+    for(std::size_t i{0}; i < iterations; ++i)
+        f();
+    glFinish();
+    std::chrono::duration<double, std::milli> elapsed = clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+}}
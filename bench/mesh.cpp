@@ -0,0 +1,99 @@
+
+// Copyright Ricardo Calheiros de Miranda Cosme 2017.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include "context.hpp"
+
+#include <freijo/mesh_file.hpp>
+#include <glm/vec3.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+// Load a mesh file to the GPU reading it to the heap(read) or
+// streaming it from the mapped file(load). Each mode runs in its own
+// process to report its own peak resident memory.
+//
+// Usage: mesh write <megabytes> <path>
+//        mesh read <path>
+//        mesh load <path>
+
+struct vertex
+{
+    glm::vec3 position;
+    glm::vec3 normal;
+};
+
+static long peak_rss_mb()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024;
+}
+
+static void write(std::size_t megabytes, const std::string& path)
+{
+    auto n = megabytes * 1024 * 1024 / sizeof(vertex);
+    std::vector<vertex> vertices(n);
+    for(std::size_t i{0}; i < n; ++i)
+        vertices[i] = {glm::vec3(i, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f)};
+    std::vector<GLuint> indices;
+    for(GLuint i{0}; i + 2 < 60000; ++i)
+        indices.insert(indices.end(), {i, i + 1, i + 2});
+    freijo::write_mesh(path, vertices, indices);
+    std::printf("%zu vertices, %zu indices\n", n, indices.size());
+}
+
+int main(int argc, char** argv)
+{
+    std::string mode{argc > 1 ? argv[1] : ""};
+    if(argc < 3 || (mode == "write" && argc < 4))
+    {
+        std::fprintf(stderr, "usage: mesh write <megabytes> <path>\n"
+                             "       mesh read|load <path>\n");
+        return 1;
+    }
+    if(mode == "write")
+    {
+        write(std::atol(argv[2]), argv[3]);
+        return 0;
+    }
+
+    freijo::bench::context ctx;
+    std::size_t vertices{0};
+    auto rss = peak_rss_mb();
+    auto ms = freijo::bench::time_ms([&]
+    {
+        if(mode == "read")
+        {
+            std::ifstream in(argv[2], std::ios::binary | std::ios::ate);
+            std::vector<char> data(in.tellg());
+            in.seekg(0);
+            in.read(data.data(), data.size());
+            freijo::mesh_header h;
+            std::memcpy(&h, data.data(), sizeof(h));
+            freijo::VBO<vertex> vbo(freijo::make_view(
+                reinterpret_cast<const vertex*>(data.data() + h.vertex_offset),
+                h.vertex_count));
+            vertices = vbo.size();
+        }
+        else
+        {
+            freijo::mesh_file mesh(argv[2]);
+            auto vbo = freijo::load_vertices<vertex>(mesh);
+            auto ebo = freijo::load_indices(mesh);
+            vertices = vbo.size();
+        }
+    }, 1);
+    std::printf("%s: %zu vertices in %.1f ms, peak RSS %ld MB "
+                "(%ld MB before)\n", mode.c_str(), vertices, ms,
+                peak_rss_mb(), rss);
+}
@@ -0,0 +1,84 @@
+
+// Copyright Ricardo Calheiros de Miranda Cosme 2017.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include "context.hpp"
+
+#include <freijo/readback.hpp>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// Compare the readback of rendered frames with a synchronous
+// glReadPixels and with readback_queue. Each frame clears the
+// framebuffer with a different color and reads it back. The
+// "encoder" only touches one byte of each row.
+//
+// Usage: readback [width] [height] [frames] [slots]
+
+static std::uint64_t checksum{0};
+
+static void encode(const GLubyte* pixels, std::size_t stride,
+                   GLsizei height)
+{
+    for(GLsizei y{0}; y < height; ++y)
+        checksum += pixels[y * stride];
+}
+
+static void render(std::size_t frame)
+{
+    auto c = static_cast<float>(frame % 256) / 255.0f;
+    glClearColor(c, 1.0f - c, 0.5f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+}
+
+int main(int argc, char** argv)
+{
+    GLsizei width = argc > 1 ? std::atoi(argv[1]) : 1920;
+    GLsizei height = argc > 2 ? std::atoi(argv[2]) : 1080;
+    std::size_t frames = argc > 3 ? std::atol(argv[3]) : 100;
+    std::size_t slots = argc > 4 ? std::atol(argv[4]) : 3;
+
+    freijo::bench::context ctx(4, 5, width, height);
+    std::size_t stride = width * 4;
+    double mb = stride * height / (1024.0 * 1024.0);
+
+    std::vector<GLubyte> pixels(stride * height);
+    std::size_t frame{0};
+    auto sync = freijo::bench::time_ms([&]
+    {
+        render(frame++);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE,
+                     pixels.data());
+        encode(pixels.data(), stride, height);
+    }, frames);
+
+    freijo::readback_queue queue(
+        width, height, GL_RGBA, GL_UNSIGNED_BYTE, slots,
+        [&](const freijo::readback_queue::frame& f)
+        {
+            encode(static_cast<const GLubyte*>(f.pixels), f.stride,
+                   height);
+        });
+    frame = 0;
+    auto async = freijo::bench::time_ms([&]
+    {
+        render(frame++);
+        queue.read();
+        queue.poll();
+    }, frames);
+    queue.flush();
+
+    std::printf("%dx%d, %zu frames, %zu slots\n", width, height, frames,
+                slots);
+    std::printf("glReadPixels:   %8.3f ms/frame %8.1f MB/s\n",
+                sync, mb * 1000.0 / sync);
+    std::printf("readback_queue: %8.3f ms/frame %8.1f MB/s, %zu stalls\n",
+                async, mb * 1000.0 / async, queue.stalls());
+    std::printf("checksum %llu\n",
+                static_cast<unsigned long long>(checksum));
+}
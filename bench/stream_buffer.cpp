@@ -0,0 +1,111 @@
+#include "context.hpp"
+
+#include <freijo/VAO.hpp>
+#include <freijo/buffer.hpp>
+#include <freijo/enable.hpp>
+#include <freijo/program.hpp>
+#include <freijo/shader.hpp>
+#include <freijo/stream_buffer.hpp>
+#include <glm/vec3.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// Compare the upload of dynamic vertex data with buffer::reset() and
+// with stream_buffer. Each frame rewrites all the vertices and draws
+// them as points. The rasterizer is discarded to measure the transfers
+// instead of the rasterization of llvmpipe.
+//
+// Usage: stream_buffer [vertices] [frames]
+
+const std::string vtxSrc = R"(
+#version 330 core
+layout (location = 0) in vec3 pos;
+
+void main()
+{
+  gl_Position = vec4(pos, 1.0);
+  gl_PointSize = 1.0;
+}
+)";
+
+const std::string fragSrc = R"(
+#version 330 core
+out vec4 color;
+
+void main()
+{
+  color = vec4(1.0f, 0.5f, 0.2f, 1.0f);
+}
+)";
+
+static void animate(std::vector<glm::vec3>& vertices, std::size_t frame)
+{
+    auto s = static_cast<float>(frame % 100) / 100.0f;
+    for(std::size_t i{0}; i < vertices.size(); ++i)
+        vertices[i] = glm::vec3(s, -s, static_cast<float>(i % 2));
+}
+
+int main(int argc, char** argv)
+{
+    std::size_t nvertices = argc > 1 ? std::atol(argv[1]) : 1 << 20;
+    std::size_t frames = argc > 2 ? std::atol(argv[2]) : 100;
+
+    freijo::bench::context ctx;
+    auto program = freijo::program{
+        freijo::vertex_shader(vtxSrc).id(),
+        freijo::fragment_shader(fragSrc).id(),
+    };
+    program.use();
+    freijo::enable discard(GL_RASTERIZER_DISCARD);
+
+    std::vector<glm::vec3> vertices(nvertices);
+    std::size_t frame{0};
+
+    {
+        freijo::VBO<glm::vec3> vbo(vertices);
+        freijo::VAO vao;
+        vao.attach(0, vbo);
+        freijo::scoped_vao_bind s(vao);
+        auto ms = freijo::bench::time_ms([&]{
+            animate(vertices, frame++);
+            vbo.bind();
+            vbo.reset(vertices.data(), vertices.data() + vertices.size());
+            glDrawArrays(GL_POINTS, 0, vertices.size());
+        }, frames);
+        std::printf("reset(equal size):     %8.3f ms/frame\n", ms);
+    }
+
+    {
+        freijo::VBO<glm::vec3> vbo(vertices);
+        freijo::VAO vao;
+        auto ms = freijo::bench::time_ms([&]{
+            animate(vertices, frame++);
+            auto n = vertices.size() - frame % 2;
+            vbo.reset(vertices.data(), vertices.data() + n);
+            vao.attach(0, vbo);
+            freijo::scoped_vao_bind s(vao);
+            glDrawArrays(GL_POINTS, 0, n);
+        }, frames);
+        std::printf("reset(different size): %8.3f ms/frame\n", ms);
+    }
+
+    {
+        freijo::stream_buffer<glm::vec3, freijo::ArrayBuffer<glm::vec3>>
+            stream(nvertices);
+        freijo::VAO vao;
+        vao.attach(0, stream);
+        freijo::scoped_vao_bind s(vao);
+        auto ms = freijo::bench::time_ms([&]{
+            animate(vertices, frame++);
+            auto r = stream.next();
+            std::copy(vertices.begin(), vertices.end(), r.data);
+            glDrawArrays(GL_POINTS, r.first, r.size);
+            stream.commit();
+        }, frames);
+        std::printf("stream_buffer:         %8.3f ms/frame (%zu stalls)\n",
+                    ms, stream.stalls());
+    }
+}
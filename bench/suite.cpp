@@ -0,0 +1,418 @@
+
+// Copyright Ricardo Calheiros de Miranda Cosme 2017.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include "context.hpp"
+
+#include <freijo/VAO.hpp>
+#include <freijo/batch.hpp>
+#include <freijo/buffer.hpp>
+#include <freijo/buffer_arena.hpp>
+#include <freijo/command_list.hpp>
+#include <freijo/draw.hpp>
+#include <freijo/enable.hpp>
+#include <freijo/fence.hpp>
+#include <freijo/gpu_vector.hpp>
+#include <freijo/packed.hpp>
+#include <freijo/program.hpp>
+#include <freijo/render_queue.hpp>
+#include <freijo/shader.hpp>
+#include <freijo/texture.hpp>
+#include <freijo/vertex_format.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Suite of micro benchmarks of the library. Each benchmark prints one
+// JSON object per line (JSON Lines) with the median time of an
+// operation over the repetitions, so the output of two releases can
+// be compared by a script:
+//
+// {"name":"reset_equal","elements":1048576,"iterations":50,
+//  "ns_per_op":1234.5,"ops_per_s":810044.5}
+//
+// The first line describes the driver.
+//
+// Usage: suite [filter] [repetitions]
+//
+// Only the benchmarks whose names contain `filter` are run.
+
+const std::string vtxSrc = R"(
+#version 330 core
+layout (location = 0) in vec3 pos;
+
+void main()
+{
+  gl_Position = vec4(pos, 1.0);
+}
+)";
+
+const std::string fragSrc = R"(
+#version 330 core
+out vec4 color;
+
+void main()
+{
+  color = vec4(1.0f, 0.5f, 0.2f, 1.0f);
+}
+)";
+
+static const char* filter{""};
+static std::size_t repetitions{5};
+
+// Run `f` `iterations` times per repetition and print the median
+// time of one call divided by `ops`, the operations done by a call.
+template<typename F>
+static void measure(const char* name, std::size_t elements,
+                    std::size_t iterations, F&& f, std::size_t ops = 1)
+{
+    if(!std::strstr(name, filter)) return;
+    std::vector<double> samples;
+    for(std::size_t r{0}; r < repetitions; ++r)
+        samples.push_back(freijo::bench::time_ms(f, iterations));
+    std::sort(samples.begin(), samples.end());
+    auto ns = samples[samples.size() / 2] * 1e6 / ops;
+    std::printf("{\"name\":\"%s\",\"elements\":%zu,\"iterations\":%zu,"
+                "\"ns_per_op\":%.1f,\"ops_per_s\":%.1f}\n",
+                name, elements, iterations, ns, 1e9 / ns);
+    std::fflush(stdout);
+}
+
+static void buffers(std::size_t n, std::size_t iterations)
+{
+    std::vector<glm::vec3> vertices(n, glm::vec3(1.0f));
+
+    measure("buffer_construct", n, iterations, [&]{
+        freijo::VBO<glm::vec3> vbo(vertices);
+    });
+
+    {
+        freijo::VBO<glm::vec3> vbo(vertices);
+        measure("reset_equal", n, iterations, [&]{
+            vbo.reset(vertices.data(), vertices.data() + n);
+        });
+    }
+
+    {
+        freijo::VBO<glm::vec3> vbo(vertices);
+        std::size_t i{0};
+        measure("reset_different", n, iterations, [&]{
+            vbo.reset(vertices.data(), vertices.data() + n - i++ % 2);
+        });
+    }
+
+    {
+        freijo::VBO<glm::vec3> vbo(vertices);
+        measure("map_unmap", n, iterations, [&]{
+            auto p = vbo.map(GL_WRITE_ONLY);
+            std::copy(vertices.begin(), vertices.end(), p);
+            vbo.unmap();
+        });
+    }
+
+    {
+        // Write 1% of the buffer
+        freijo::VBO<glm::vec3> vbo(vertices);
+        const std::size_t count{std::max<std::size_t>(n / 100, 1)};
+        measure("map_range_1pct", n, iterations, [&]{
+            auto view = vbo.map_range(n / 2, count, GL_MAP_WRITE_BIT
+                                      | GL_MAP_INVALIDATE_RANGE_BIT);
+            std::copy(vertices.begin(), vertices.begin() + count,
+                      view.begin());
+        });
+    }
+
+    {
+        freijo::VBO<glm::vec3> vbo(vertices);
+        measure("copy_from", n, iterations, [&]{
+            freijo::VBO<glm::vec3> copy(vbo);
+        });
+    }
+
+    {
+        // Append the vertices in chunks of 64, growing from empty.
+        const std::size_t chunk{std::min<std::size_t>(64, n)};
+        measure("gpu_vector_append", n, iterations, [&]{
+            freijo::VBO_vector<glm::vec3> vec;
+            for(std::size_t i{0}; i + chunk <= n; i += chunk)
+                vec.push_back(vertices.data() + i,
+                              vertices.data() + i + chunk);
+        }, n / chunk);
+    }
+}
+
+// Update a buffer that the previous draw reads, with each policy.
+static void updates(std::size_t n, std::size_t iterations)
+{
+    freijo::program program{
+        freijo::vertex_shader(vtxSrc).id(),
+        freijo::fragment_shader(fragSrc).id()};
+    program.use();
+    freijo::enable discard(GL_RASTERIZER_DISCARD);
+    std::vector<glm::vec3> vertices(n, glm::vec3(0.5f));
+
+    struct policy { const char* name; freijo::update_policy policy; };
+    const policy policies[] = {
+        {"update_sub_data", freijo::update_policy::sub_data},
+        {"update_orphan", freijo::update_policy::orphan},
+        {"update_invalidate", freijo::update_policy::invalidate},
+        {"update_unsynchronized", freijo::update_policy::unsynchronized}};
+    for(auto& p : policies)
+    {
+        freijo::VBO<glm::vec3> vbo(vertices, GL_STREAM_DRAW);
+        freijo::VAO vao;
+        vao.attach(0, vbo);
+        freijo::fence guard;
+        measure(p.name, n, iterations, [&]{
+            if(p.policy == freijo::update_policy::unsynchronized)
+                vbo.update(vertices.begin(), vertices.end(), 0, guard);
+            else
+                vbo.update(vertices.begin(), vertices.end(), 0, p.policy);
+            freijo::draw_arrays(GL_POINTS, vao, vbo);
+            guard.set();
+        });
+    }
+}
+
+// Conversion of vertices to the packed formats, per vertex
+static void packing(std::size_t n, std::size_t iterations)
+{
+    std::vector<glm::vec3> normals(n);
+    std::vector<glm::vec4> colors(n);
+    for(std::size_t i{0}; i < n; ++i)
+    {
+        auto f = static_cast<float>(i) / n;
+        normals[i] = glm::vec3(f, 1.0f - f, -f);
+        colors[i] = glm::vec4(f, f, 1.0f - f, 1.0f);
+    }
+    std::vector<freijo::half4> h(n);
+    measure("pack_half4", n, iterations, [&]{
+        freijo::pack(normals.data(), normals.data() + n, h.data());
+    }, n);
+    std::vector<freijo::snorm_2_10_10_10> p(n);
+    measure("pack_2_10_10_10", n, iterations, [&]{
+        freijo::pack(normals.data(), normals.data() + n, p.data());
+    }, n);
+    std::vector<freijo::normalized<glm::tvec4<GLbyte>>> b(n);
+    measure("pack_snorm8", n, iterations, [&]{
+        freijo::pack(normals.data(), normals.data() + n, b.data());
+    }, n);
+    std::vector<freijo::normalized<glm::tvec4<GLubyte>>> u(n);
+    measure("pack_unorm8", n, iterations, [&]{
+        freijo::pack(colors.data(), colors.data() + n, u.data());
+    }, n);
+}
+
+static void objects(std::size_t iterations)
+{
+    freijo::VBO<glm::vec3> vbo(std::size_t(1024));
+    freijo::EBO<GLuint> ebo(std::size_t(1024));
+    measure("vao_setup", 1, iterations, [&]{
+        freijo::VAO vao;
+        vao.attach(0, vbo);
+        vao.attach(ebo);
+    });
+
+    // Switch a VAO between the buffers of two meshes
+    freijo::VBO<glm::vec3> positions[2]{
+        freijo::VBO<glm::vec3>(std::size_t(1024)),
+        freijo::VBO<glm::vec3>(std::size_t(1024))};
+    freijo::VBO<glm::vec4> colors[2]{
+        freijo::VBO<glm::vec4>(std::size_t(1024)),
+        freijo::VBO<glm::vec4>(std::size_t(1024))};
+    {
+        freijo::VAO vao;
+        std::size_t i{0};
+        measure("vao_switch_attach", 1, iterations, [&]{
+            vao.attach(0, positions[i % 2]);
+            vao.attach(1, colors[i++ % 2]);
+        });
+    }
+
+    {
+        freijo::vertex_format<glm::vec3, glm::vec4> format;
+        std::size_t i{0};
+        measure("vertex_format_switch", 1, iterations, [&]{
+            auto n = i++;
+            format.bind_buffers(positions[n % 2], colors[n % 2]);
+        });
+    }
+
+    measure("program_link", 1, iterations / 10 + 1, [&]{
+        freijo::program p{
+            freijo::vertex_shader(vtxSrc).id(),
+            freijo::fragment_shader(fragSrc).id()};
+    });
+}
+
+static void draws(std::size_t ndraws, std::size_t iterations)
+{
+    freijo::program program{
+        freijo::vertex_shader(vtxSrc).id(),
+        freijo::fragment_shader(fragSrc).id()};
+    program.use();
+    freijo::enable discard(GL_RASTERIZER_DISCARD);
+
+    std::vector<glm::vec3> vertices(3, glm::vec3(0.0f));
+    std::vector<GLuint> indices{0, 1, 2};
+
+    {
+        freijo::VBO<glm::vec3> vbo(vertices);
+        freijo::VAO vao;
+        vao.attach(0, vbo);
+        measure("draw_arrays", ndraws, iterations, [&]{
+            for(std::size_t i{0}; i < ndraws; ++i)
+                freijo::draw_arrays(GL_TRIANGLES, vao, vbo);
+        }, ndraws);
+    }
+
+    freijo::buffer_arena arena(1 << 20);
+    auto vbo = arena.allocate<freijo::VBO_slice<glm::vec3>>
+        (vertices.data(), vertices.data() + vertices.size());
+    auto ebo = arena.allocate<freijo::EBO_slice<GLuint>>
+        (indices.data(), indices.data() + indices.size());
+    freijo::VAO vao;
+    vao.attach(0, vbo);
+    vao.attach(ebo);
+
+    measure("draw_elements_base_vertex", ndraws, iterations, [&]{
+        for(std::size_t i{0}; i < ndraws; ++i)
+            freijo::draw_elements(GL_TRIANGLES, vao, ebo, vbo);
+    }, ndraws);
+
+    freijo::indirect_batch<GLuint> batch(ndraws);
+    measure("indirect_batch", ndraws, iterations, [&]{
+        for(std::size_t i{0}; i < ndraws; ++i)
+            batch.add(program, vao, ebo, vbo);
+        batch.submit(GL_TRIANGLES);
+    }, ndraws);
+}
+
+// Draws in random order over 4 programs, 8 VAOs and 2 sets of
+// capabilities, issued directly or through a render_queue
+static void queues(std::size_t ndraws, std::size_t iterations)
+{
+    std::vector<freijo::program> programs;
+    for(std::size_t i{0}; i < 4; ++i)
+        programs.emplace_back(freijo::program::Shaders{
+            freijo::vertex_shader(vtxSrc).id(),
+            freijo::fragment_shader(fragSrc).id()});
+    freijo::VBO<glm::vec3> vbo(std::vector<glm::vec3>(3, glm::vec3(0.0f)));
+    std::vector<freijo::VAO> vaos(8);
+    for(auto& vao : vaos) vao.attach(0, vbo);
+    freijo::enable discard(GL_RASTERIZER_DISCARD);
+
+    struct draw { std::size_t program, vao; bool blend; };
+    std::vector<draw> frame(ndraws);
+    unsigned seed{1};
+    for(auto& d : frame)
+    {
+        seed = seed * 1103515245u + 12345u;
+        d = draw{(seed >> 8) % 4, (seed >> 12) % 8, ((seed >> 16) & 1) != 0};
+    }
+
+    measure("draw_unsorted", ndraws, iterations, [&]{
+        for(auto& d : frame)
+        {
+            programs[d.program].use();
+            freijo::enable depth(GL_DEPTH_TEST);
+            if(d.blend)
+            {
+                freijo::enable blend(GL_BLEND);
+                freijo::draw_arrays(GL_TRIANGLES, vaos[d.vao], vbo);
+            }
+            else
+                freijo::draw_arrays(GL_TRIANGLES, vaos[d.vao], vbo);
+        }
+    }, ndraws);
+
+    // Recording without GL calls and replay of one list of uniform
+    // blocks and draws
+    {
+        freijo::command_list list;
+        freijo::command_queue submitter;
+        const glm::vec4 block(1.0f);
+        auto record = [&]{
+            list.clear();
+            for(auto& d : frame)
+            {
+                list.uniform(0, block);
+                list.draw_arrays(freijo::render_state{programs[d.program],
+                                                      vaos[d.vao]},
+                                 GL_TRIANGLES, vbo);
+            }
+        };
+        measure("command_list_record", ndraws, iterations, record, ndraws);
+        record();
+        measure("command_queue_submit", ndraws, iterations, [&]{
+            submitter.submit(list);
+        }, ndraws);
+    }
+
+    freijo::render_queue queue(ndraws);
+    const freijo::enable_set sets[2] = {
+        {GL_DEPTH_TEST, GL_RASTERIZER_DISCARD},
+        {GL_DEPTH_TEST, GL_BLEND, GL_RASTERIZER_DISCARD}};
+    measure("render_queue", ndraws, iterations, [&]{
+        for(auto& d : frame)
+            queue.draw_arrays(freijo::render_state{programs[d.program],
+                                                   vaos[d.vao],
+                                                   sets[d.blend]},
+                              GL_TRIANGLES, vbo);
+        queue.submit();
+    }, ndraws);
+}
+
+// Update of a tile of a texture from client memory and through the
+// ring of pixel unpack buffers, per tile
+static void textures(std::size_t size, std::size_t iterations)
+{
+    using pixel = glm::tvec4<GLubyte>;
+    const GLsizei tile = size;
+    std::vector<pixel> pixels(size * size, pixel(255));
+    freijo::texture_2d<pixel> texture(tile * 4, tile * 4, 1);
+
+    std::size_t i{0};
+    measure("texture_sub_image", size * size, iterations, [&]{
+        auto n = i++;
+        auto x = GLint(n % 4) * tile, y = GLint(n / 4 % 4) * tile;
+        texture.update(pixels.data(), x, y, tile, tile);
+    });
+
+    freijo::texture_stream<pixel> stream(size * size * 4);
+    stream.begin_frame();
+    measure("texture_stream", size * size, iterations, [&]{
+        auto n = i++;
+        auto x = GLint(n % 4) * tile, y = GLint(n / 4 % 4) * tile;
+        stream.update(texture, pixels.data(), x, y, tile, tile);
+    });
+    stream.end_frame();
+    glFinish();
+}
+
+int main(int argc, char** argv)
+{
+    filter = argc > 1 ? argv[1] : "";
+    repetitions = argc > 2 ? std::atol(argv[2]) : 5;
+
+    freijo::bench::context ctx;
+    std::printf("{\"renderer\":\"%s\",\"version\":\"%s\"}\n",
+                glGetString(GL_RENDERER), glGetString(GL_VERSION));
+
+    buffers(1 << 10, 1000);
+    buffers(1 << 20, 20);
+    updates(1 << 16, 200);
+    packing(1 << 20, 20);
+    objects(200);
+    draws(1000, 20);
+    queues(1000, 20);
+    textures(256, 100);
+}
@@ -0,0 +1,102 @@
+// Copyright Ricardo Calheiros de Miranda Cosme 2017.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include "context.hpp"
+
+#include <freijo/VAO.hpp>
+#include <freijo/draw.hpp>
+#include <freijo/enable.hpp>
+#include <freijo/program.hpp>
+#include <freijo/shader.hpp>
+#include <freijo/uploader.hpp>
+#include <glm/vec3.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// Longest frame of a render loop while a large buffer is loaded on
+// the render thread(sync) or by an uploader on a shared context
+// (async). Each frame draws a triangle and the buffer is used as soon
+// as it's loaded.
+//
+// Usage: upload [megabytes]
+
+static const std::string vtxSrc = R"(
+#version 330 core
+layout (location = 0) in vec3 position;
+void main()
+{
+  gl_Position = vec4(position, 1.0f);
+}
+)";
+
+using clock_type = std::chrono::steady_clock;
+
+static double elapsed_ms(clock_type::time_point start)
+{
+    return std::chrono::duration<double, std::milli>
+        (clock_type::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+    const std::size_t megabytes = argc > 1 ? std::atol(argv[1]) : 256;
+    const std::size_t n{megabytes * 1024 * 1024 / sizeof(glm::vec3)};
+
+    freijo::bench::context ctx;
+    freijo::bench::shared_context loader(ctx);
+    freijo::uploader up([&]{ loader.make_current(); },
+                        [&]{ loader.release(); });
+
+    freijo::program program{freijo::vertex_shader(vtxSrc).id()};
+    program.use();
+    freijo::enable discard(GL_RASTERIZER_DISCARD);
+    freijo::VBO<glm::vec3> triangle(std::vector<glm::vec3>(3));
+    freijo::VAO vao;
+    vao.attach(0, triangle);
+
+    for(std::string mode : {"sync", "async"})
+    {
+        std::vector<glm::vec3> vertices(n, glm::vec3(1.0f));
+        freijo::VBO<glm::vec3> mesh;
+        freijo::pending_buffer<freijo::VBO<glm::vec3>> pending;
+        bool loaded{false};
+        double longest{0};
+        std::size_t frames{0};
+        auto start = clock_type::now();
+        // The mesh is loaded on the third frame and the loop runs until
+        // it's ready and at least 10 frames are drawn.
+        while(!loaded || frames < 10)
+        {
+            auto frame = clock_type::now();
+            if(frames == 2)
+            {
+                if(mode == "sync")
+                {
+                    mesh = freijo::VBO<glm::vec3>(vertices);
+                    loaded = true;
+                }
+                else
+                    pending = up.create<glm::vec3>(std::move(vertices));
+            }
+            if(frames > 2 && !loaded && pending.ready())
+            {
+                mesh = pending.get();
+                loaded = true;
+            }
+            freijo::draw_arrays(GL_TRIANGLES, vao, triangle);
+            glFinish();
+            longest = std::max(longest, elapsed_ms(frame));
+            ++frames;
+        }
+        std::printf("%s: %zu MB, longest frame %.1f ms, %zu frames in "
+                    "%.1f ms\n", mode.c_str(), megabytes, longest, frames,
+                    elapsed_ms(start));
+    }
+}
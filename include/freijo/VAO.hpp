@@ -7,43 +7,62 @@
 #pragma once
 
 #include "freijo/buffer.hpp"
+#include "freijo/state.hpp"
 
 #include <cstddef>
 #include <algorithm>
+#include <tuple>
+#include <type_traits>
 
 namespace freijo {
 
 class VAO_base
 {
 public:
-    VAO_base() { glGenVertexArrays(1, &_id); }
-    ~VAO_base() { glDeleteVertexArrays(1, &_id); }
+    VAO_base()
+    {
+#ifdef FREIJO_DSA
+        glCreateVertexArrays(1, &_id);
+#else
+        glGenVertexArrays(1, &_id);
+#endif
+    }
+    
+    ~VAO_base()
+    {
+        glDeleteVertexArrays(1, &_id);
+        state().vertex_array_deleted(_id);
+    }
     
-    void bind() const { glBindVertexArray(_id); }    
-    void unbind() const { glBindVertexArray(0); }
+    void bind() const { state().bind_vertex_array(_id); }    
+    void unbind() const { state().bind_vertex_array(0); }
     
     unsigned int id() const noexcept { return _id; }
 protected:    
     unsigned int _id{0};
 };
     
-/* RAII to bind()/unbind() */ 
+/* RAII to bind()/unbind() that restores the VAO bound before */ 
 class scoped_vao_bind
 {
 public:
     explicit scoped_vao_bind(const VAO_base& vao_base)
-        : _vao_base(vao_base)
-    { _vao_base.bind(); }
+        : _previous(state().vertex_array())
+    { vao_base.bind(); }
     
-    ~scoped_vao_bind() { _vao_base.unbind(); }
+    ~scoped_vao_bind() { state().bind_vertex_array(_previous); }
     
     scoped_vao_bind(const scoped_vao_bind&) = delete;
     scoped_vao_bind& operator=(const scoped_vao_bind&) = delete;
 private:
-    const VAO_base& _vao_base;
+    GLuint _previous;
 };
     
 /* VAO (Vertex Array Object)
+ *
+ * If FREIJO_DSA is defined the VAO is edited through Direct State
+ * Access (OpenGL 4.5 or ARB_direct_state_access) instead of binding
+ * it, and the buffers, to the context.
  *
  * Model the concepts Movable and EqualityComparable.
  */            
@@ -62,53 +81,208 @@ public:
     }
     
     template<typename VBO>
-    void attach(std::size_t index, const VBO& vbo,
-                GLsizei stride = 0,
-                std::size_t offset = 0,
-                GLboolean normalized = GL_FALSE) const
-    {
-        scoped_vao_bind sb(*this);
-        scoped_buffer_bind<VBO> sbb(vbo);
-        glVertexAttribPointer(index,
-                              VBO::target::size,
-                              VBO::target::type,
-                              normalized, stride,
-                              reinterpret_cast<void*>(offset));
-        glEnableVertexAttribArray(index);
-    }
+    typename std::enable_if<
+        !is_interleaved<typename VBO::value_type>::value>::type
+    attach(std::size_t index, const VBO& vbo,
+           GLsizei stride = 0,
+           std::size_t offset = 0,
+           GLboolean normalized = GL_FALSE) const
+    { attach_buffer(index, vbo, stride, offset, normalized, 0); }
+
+    /* Attach a VBO of interleaved vertices (see VertexLayout).
+     *
+     * Each attribute of the layout is attached to a consecutive index
+     * starting at `index`, with the stride and offsets of the layout.
+     */
+    template<typename VBO>
+    typename std::enable_if<
+        is_interleaved<typename VBO::value_type>::value>::type
+    attach(std::size_t index, const VBO& vbo,
+           std::size_t offset = 0) const
+    { attach_layout(index, vbo, offset, 0); }
+
+    /* Attach a VBO of per-instance attributes.
+     *
+     * The attribute advances once every `divisor` instances
+     * (glVertexAttribDivisor) instead of once per vertex. A matrix
+     * attribute, e.g. glm::mat4, spans one index per column.
+     */
+    template<typename VBO>
+    typename std::enable_if<
+        !is_interleaved<typename VBO::value_type>::value>::type
+    attach_instanced(std::size_t index, const VBO& vbo,
+                     GLuint divisor = 1,
+                     GLsizei stride = 0,
+                     std::size_t offset = 0,
+                     GLboolean normalized = GL_FALSE) const
+    { attach_buffer(index, vbo, stride, offset, normalized, divisor); }
+
+    /* Attach a VBO of interleaved per-instance attributes. */
+    template<typename VBO>
+    typename std::enable_if<
+        is_interleaved<typename VBO::value_type>::value>::type
+    attach_instanced(std::size_t index, const VBO& vbo,
+                     GLuint divisor = 1,
+                     std::size_t offset = 0) const
+    { attach_layout(index, vbo, offset, divisor); }
 
     template<typename EBO>
     void attach(const EBO& ebo) const
     {
+#ifdef FREIJO_DSA
+        glVertexArrayElementBuffer(_id, ebo.id());
+        state().element_buffer_attached(_id, ebo.id());
+#else
         scoped_vao_bind sb(*this);
         ebo.bind();
+#endif
     }    
                 
     void detach(std::size_t index) const
     {
+#ifdef FREIJO_DSA
+        glDisableVertexArrayAttrib(_id, index);
+        glVertexArrayVertexBuffer(_id, index, 0, 0, 0);
+#else
         scoped_vao_bind sb(*this);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        state().bind_buffer(GL_ARRAY_BUFFER, 0);
         glDisableVertexAttribArray(index);
+#endif
     }
 
     template<typename EBO>
     void detach(const EBO& ebo) const
     {
+#ifdef FREIJO_DSA
+        glVertexArrayElementBuffer(_id, 0);
+        state().element_buffer_attached(_id, 0);
+#else
         scoped_vao_bind sb(*this);
         ebo.unbind();
+#endif
     }
     
     void enable_attrib(std::size_t index) const
     {
+#ifdef FREIJO_DSA
+        glEnableVertexArrayAttrib(_id, index);
+#else
         scoped_vao_bind sb(*this);
         glEnableVertexAttribArray(index);
+#endif
     }
             
     void disable_attrib(std::size_t index) const
     {
+#ifdef FREIJO_DSA
+        glDisableVertexArrayAttrib(_id, index);
+#else
         scoped_vao_bind sb(*this);
         glDisableVertexAttribArray(index);
+#endif
     }    
+private:
+    template<typename VBO>
+    void attach_buffer(std::size_t index, const VBO& vbo,
+                       GLsizei stride, std::size_t offset,
+                       GLboolean normalized, GLuint divisor) const
+    {
+        using target = typename VBO::target;
+        using value_type = typename VBO::value_type;
+        const std::size_t column{sizeof(value_type) / target::columns};
+        if(!stride) stride = sizeof(value_type);
+        // Packed and normalized<> types are always normalized
+        if(target::normalized) normalized = GL_TRUE;
+#ifdef FREIJO_DSA
+        glVertexArrayVertexBuffer(_id, index, vbo.id(), offset, stride);
+        glVertexArrayBindingDivisor(_id, index, divisor);
+        for(GLint c{0}; c < target::columns; ++c)
+            attrib_format(index + c, index, target::size, target::type,
+                          normalized, c * column);
+#else
+        scoped_vao_bind sb(*this);
+        scoped_buffer_bind<VBO> sbb(vbo);
+        for(GLint c{0}; c < target::columns; ++c)
+            attrib_pointer(index + c, target::size, target::type,
+                           normalized, stride, offset + c * column,
+                           divisor);
+#endif
+    }
+
+    template<typename VBO>
+    void attach_layout(std::size_t index, const VBO& vbo,
+                       std::size_t offset, GLuint divisor) const
+    {
+        using layout = typename VBO::target::layout;
+#ifdef FREIJO_DSA
+        glVertexArrayVertexBuffer(_id, index, vbo.id(), offset,
+                                  layout::stride);
+        glVertexArrayBindingDivisor(_id, index, divisor);
+#else
+        scoped_vao_bind sb(*this);
+        scoped_buffer_bind<VBO> sbb(vbo);
+#endif
+        attach_attribs(index, offset, layout::stride, divisor,
+                       static_cast<typename layout::attribs*>(nullptr));
+    }
+
+    template<typename... Attribs>
+    void attach_attribs(std::size_t index, std::size_t offset,
+                        GLsizei stride, GLuint divisor,
+                        std::tuple<Attribs...>*) const
+    {
+        auto location = index;
+        int expand[] = {0, (attach_attrib<Attribs>(location, index, offset,
+                                                   stride, divisor),
+                            location += Attribs::columns, 0)...};
+        (void)expand;
+    }
+
+    template<typename Attrib>
+    void attach_attrib(std::size_t location, std::size_t binding,
+                       std::size_t offset, GLsizei stride,
+                       GLuint divisor) const
+    {
+        const std::size_t column{sizeof(typename Attrib::type)
+                                 / Attrib::columns};
+        for(GLint c{0}; c < Attrib::columns; ++c)
+        {
+#ifdef FREIJO_DSA
+            (void)offset; (void)stride; (void)divisor;
+            attrib_format(location + c, binding, Attrib::size,
+                          Attrib::gltype, Attrib::normalized,
+                          Attrib::offset + c * column);
+#else
+            (void)binding;
+            attrib_pointer(location + c, Attrib::size, Attrib::gltype,
+                           Attrib::normalized, stride,
+                           offset + Attrib::offset + c * column, divisor);
+#endif
+        }
+    }
+
+#ifdef FREIJO_DSA
+    void attrib_format(std::size_t location, std::size_t binding,
+                       GLint size, GLenum type, GLboolean normalized,
+                       std::size_t relative_offset) const
+    {
+        glVertexArrayAttribFormat(_id, location, size, type, normalized,
+                                  relative_offset);
+        glVertexArrayAttribBinding(_id, location, binding);
+        glEnableVertexArrayAttrib(_id, location);
+    }
+#else
+    /* precondition: the VAO and the buffer are bound */
+    void attrib_pointer(std::size_t location, GLint size, GLenum type,
+                        GLboolean normalized, GLsizei stride,
+                        std::size_t offset, GLuint divisor) const
+    {
+        glVertexAttribPointer(location, size, type, normalized, stride,
+                              reinterpret_cast<void*>(offset));
+        glVertexAttribDivisor(location, divisor);
+        glEnableVertexAttribArray(location);
+    }
+#endif
 };
 
 inline
@@ -0,0 +1,176 @@
+
+// Copyright Ricardo Calheiros de Miranda Cosme 2017.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "freijo/VAO.hpp"
+#include "freijo/buffer.hpp"
+#include "freijo/buffer_arena.hpp"
+#include "freijo/program.hpp"
+#include "freijo/stream_buffer.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace freijo {
+
+/// Parameters of an indirect indexed draw
+/// (Section 10.4 Drawing Commands at OpenGL 4.5 Core Profile)
+struct draw_elements_indirect_command
+{
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint base_vertex;
+    GLuint base_instance;
+};
+
+static_assert(sizeof(draw_elements_indirect_command) == 5 * sizeof(GLuint),
+              "DrawElementsIndirectCommand must be tightly packed");
+
+/// Batch of indexed draws submitted with glMultiDrawElementsIndirect
+/// (OpenGL 4.3 or ARB_multi_draw_indirect)
+///
+/// The draws are grouped by program and VAO. `submit()` writes all the
+/// commands of the frame to a GL_DRAW_INDIRECT_BUFFER streamed through
+/// a stream_buffer and issues a single glMultiDrawElementsIndirect for
+/// each group, so the CPU cost doesn't grow with the number of draws.
+/// The meshes are typically slices of a buffer_arena attached to a
+/// shared VAO.
+///
+/// Example:
+///
+///   freijo::indirect_batch<GLuint> batch;
+///   for(auto& mesh : meshes)
+///       batch.add(program, vao, mesh.indices, mesh.vertices);
+///   batch.submit(GL_TRIANGLES);
+///
+/// The program and the VAO of a draw must live until the draw is
+/// submitted.
+///
+/// /tparam IndexType Type of the indices: GLubyte, GLushort or GLuint.
+///
+template<typename IndexType>
+class indirect_batch
+{
+public:
+    using command = draw_elements_indirect_command;
+    using index_type = IndexType;
+
+    /// /param capacity Maximum number of commands written to the
+    ///                 indirect buffer before a wait for the GPU. A
+    ///                 frame with more commands is submitted in chunks.
+    /// /param regions Number of frames in the ring of the indirect buffer.
+    explicit indirect_batch(std::size_t capacity = 4096,
+                            std::size_t regions = 3)
+        : _stream(capacity, regions)
+    {}
+
+    /// Queue a draw of `vao` with `prog`
+    void add(const program& prog, const VAO& vao, const command& cmd)
+    {
+        auto key = (static_cast<std::uint64_t>(prog.id()) << 32) | vao.id();
+        auto it = _index.find(key);
+        if(it == _index.end())
+        {
+            it = _index.emplace(key, _groups.size()).first;
+            _groups.push_back(group{&prog, &vao, {}});
+        }
+        auto& g = _groups[it->second];
+        g.prog = &prog;
+        g.vao = &vao;
+        g.commands.push_back(cmd);
+        ++_size;
+    }
+
+    /// Queue a draw of the indices of `ebo` relative to the first
+    /// vertex of `vbo`.
+    ///
+    /// precondition: the arenas of `ebo` and `vbo` are attached to `vao`
+    template<typename T, typename Target>
+    void add(const program& prog, const VAO& vao,
+             const buffer_slice<index_type, ElementArray<index_type>>& ebo,
+             const buffer_slice<T, Target>& vbo,
+             GLuint instances = 1, GLuint base_instance = 0)
+    {
+        add(prog, vao, command{static_cast<GLuint>(ebo.size()),
+                               instances,
+                               static_cast<GLuint>(ebo.first()),
+                               static_cast<GLint>(vbo.first()),
+                               base_instance});
+    }
+
+    /// Draw all the queued commands and clear the batch.
+    ///
+    /// The program and the VAO of the last group are left in use.
+    void submit(GLenum mode)
+    {
+        if(!_size) return;
+        _stream.bind();
+        auto r = _stream.next();
+        std::size_t used{0};
+        for(auto& g : _groups)
+        {
+            if(g.commands.empty()) continue;
+            g.prog->use();
+            g.vao->bind();
+            for(std::size_t done{0}; done < g.commands.size();)
+            {
+                if(used == r.size)
+                {
+                    _stream.commit();
+                    r = _stream.next();
+                    used = 0;
+                }
+                auto n = std::min(g.commands.size() - done, r.size - used);
+                std::copy(g.commands.begin() + done,
+                          g.commands.begin() + done + n,
+                          r.data + used);
+                auto offset = r.offset() + used * sizeof(command);
+                glMultiDrawElementsIndirect(
+                    mode, ElementArray<index_type>::GLtype,
+                    reinterpret_cast<void*>(offset), n, 0);
+                ++_submits;
+                used += n;
+                done += n;
+            }
+            g.commands.clear();
+        }
+        _stream.commit();
+        _size = 0;
+    }
+
+    /// Drop the queued commands
+    void clear()
+    {
+        for(auto& g : _groups) g.commands.clear();
+        _size = 0;
+    }
+
+    /// Number of queued commands
+    std::size_t size() const noexcept { return _size; }
+
+    /// Number of glMultiDrawElementsIndirect issued
+    std::size_t submits() const noexcept { return _submits; }
+private:
+    struct group
+    {
+        const program* prog;
+        const VAO* vao;
+        std::vector<command> commands;
+    };
+
+    stream_buffer<command, DrawIndirectBuffer<command>> _stream;
+    std::vector<group> _groups;
+    std::unordered_map<std::uint64_t, std::size_t> _index;
+    std::size_t _size{0};
+    std::size_t _submits{0};
+};
+
+}
@@ -6,9 +6,20 @@
 
 #pragma once
 
+#include "freijo/fence.hpp"
+#include "freijo/state.hpp"
+#include "freijo/std140.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <memory>
 #include <utility>
 #include <vector>
 #include <array>
+#include <tuple>
+#include <type_traits>
 #include <glm/glm.hpp>
 #include <glm/detail/precision.hpp>
 
@@ -66,8 +77,11 @@ struct GLTypeTraits<GLdouble>
     static const GLenum type{GL_DOUBLE};
 };
 
-//Traits para definição do tipo(type) da componente do vetor e do
-//número de componentes(size).
+//Traits para definição do tipo(type) da componente do vetor, do
+//número de componentes(size) e do número de colunas(columns). Um
+//atributo com mais de uma coluna, uma matriz, ocupa um índice
+//por coluna. Opcionalmente define normalized = GL_TRUE para tipos
+//sempre normalizados(veja packed.hpp).
 template<typename T>
 struct VertexTraits;
 
@@ -78,6 +92,7 @@ struct VertexTraits<glm::TVEC<T, P>> \
     static const GLenum type{GLTypeTraits< \
         typename glm::tvec3<T, P>::value_type>::type}; \
     static const GLint size{SIZE}; \
+    static const GLint columns{1}; \
 };
 
 //Suporte a vetores da biblioteca glm. 
@@ -85,14 +100,162 @@ VertexTraits_GLM_TVEC(tvec1, 1)
 VertexTraits_GLM_TVEC(tvec2, 2)
 VertexTraits_GLM_TVEC(tvec3, 3)
 VertexTraits_GLM_TVEC(tvec4, 4)
+
+#define VertexTraits_GLM_TMAT(TMAT, COLUMNS, ROWS)     \
+template<typename T, glm::precision P> \
+struct VertexTraits<glm::TMAT<T, P>> \
+{\
+    static const GLenum type{GLTypeTraits<T>::type}; \
+    static const GLint size{ROWS}; \
+    static const GLint columns{COLUMNS}; \
+};
+
+//Suporte a matrizes da biblioteca glm.
+VertexTraits_GLM_TMAT(tmat2x2, 2, 2)
+VertexTraits_GLM_TMAT(tmat2x3, 2, 3)
+VertexTraits_GLM_TMAT(tmat2x4, 2, 4)
+VertexTraits_GLM_TMAT(tmat3x2, 3, 2)
+VertexTraits_GLM_TMAT(tmat3x3, 3, 3)
+VertexTraits_GLM_TMAT(tmat3x4, 3, 4)
+VertexTraits_GLM_TMAT(tmat4x2, 4, 2)
+VertexTraits_GLM_TMAT(tmat4x3, 4, 3)
+VertexTraits_GLM_TMAT(tmat4x4, 4, 4)
+
+namespace detail {
+
+template<typename T>
+struct void_type { using type = void; };
+
+//Retorna VertexTraits<T>::normalized se definido, GL_FALSE caso
+//contrário.
+template<typename T, typename = void>
+struct vertex_normalized : std::integral_constant<GLboolean, GL_FALSE> {};
+
+template<typename T>
+struct vertex_normalized<
+    T, typename void_type<decltype(VertexTraits<T>::normalized)>::type>
+    : std::integral_constant<GLboolean, VertexTraits<T>::normalized> {};
+
+}
+
+//Atributo de um vértice intercalado(interleaved): tipo do membro(T),
+//posição do membro no vértice(Offset) e se o valor inteiro deve ser
+//normalizado para [0, 1] ou [-1, 1](Normalized).
+template<typename T, std::size_t Offset, GLboolean Normalized = GL_FALSE>
+struct attrib
+{
+    using type = T;
+    static const std::size_t offset = Offset;
+    static const GLboolean normalized =
+        Normalized || detail::vertex_normalized<T>::value;
+    static const GLint size = VertexTraits<T>::size;
+    static const GLenum gltype = VertexTraits<T>::type;
+    static const GLint columns = VertexTraits<T>::columns;
+};
+
+//Atributo definido pelo membro MEMBER de VERTEX.
+#define FREIJO_ATTRIB(VERTEX, MEMBER) \
+    freijo::attrib<decltype(VERTEX::MEMBER), offsetof(VERTEX, MEMBER)>
+
+//Atributo normalizado definido pelo membro MEMBER de VERTEX.
+#define FREIJO_NORMALIZED_ATTRIB(VERTEX, MEMBER) \
+    freijo::attrib<decltype(VERTEX::MEMBER), offsetof(VERTEX, MEMBER), \
+                   GL_TRUE>
+
+namespace detail {
+
+template<typename Vertex, typename... Attribs>
+struct attribs_fit : std::true_type {};
+
+template<typename Vertex, typename A, typename... Attribs>
+struct attribs_fit<Vertex, A, Attribs...>
+    : std::integral_constant<bool,
+        A::offset + sizeof(typename A::type) <= sizeof(Vertex)
+        && attribs_fit<Vertex, Attribs...>::value> {};
+
+template<typename... Attribs>
+struct attribs_disjoint : std::true_type {};
+
+template<typename A, typename B, typename... Attribs>
+struct attribs_disjoint<A, B, Attribs...>
+    : std::integral_constant<bool,
+        A::offset + sizeof(typename A::type) <= B::offset
+        && attribs_disjoint<B, Attribs...>::value> {};
+
+}
+
+//Layout de um vértice intercalado. Os atributos devem ser declarados
+//na ordem dos membros de Vertex e são ligados a índices consecutivos
+//por VAO::attach.
+template<typename Vertex, typename... Attribs>
+struct layout
+{
+    static_assert(std::is_standard_layout<Vertex>::value,
+                  "The vertex must be a standard-layout type");
+    static_assert(sizeof...(Attribs) > 0,
+                  "The layout must have at least one attribute");
+    static_assert(detail::attribs_fit<Vertex, Attribs...>::value,
+                  "An attribute lies outside of the vertex");
+    static_assert(detail::attribs_disjoint<Attribs...>::value,
+                  "The attributes must be declared in the order of the "
+                  "members and they can't overlap");
+
+    using vertex = Vertex;
+    using attribs = std::tuple<Attribs...>;
+    static const GLsizei stride = sizeof(Vertex);
+};
+
+//Traits para vértices intercalados. Deve ser especializado para
+//um tipo de vértice herdando de layout. Exemplo:
+//
+//struct Vertex { glm::vec3 position; glm::tvec4<GLubyte> color; };
+//
+//namespace freijo {
+//template<>
+//struct VertexLayout<Vertex>
+//    : layout<Vertex,
+//             FREIJO_ATTRIB(Vertex, position),
+//             FREIJO_NORMALIZED_ATTRIB(Vertex, color)> {};
+//}
+template<typename T>
+struct VertexLayout {};
+
+namespace detail {
+
+template<typename T, typename = void>
+struct is_interleaved : std::false_type {};
+
+template<typename T>
+struct is_interleaved<
+    T, typename void_type<typename VertexLayout<T>::attribs>::type>
+    : std::true_type {};
+
+template<typename T, bool Interleaved = is_interleaved<T>::value>
+struct vertex_format
+{
+    static const GLint size = VertexTraits<T>::size;
+    static const GLenum type = VertexTraits<T>::type;
+    static const GLint columns = VertexTraits<T>::columns;
+    static const GLboolean normalized = vertex_normalized<T>::value;
+};
+
+template<typename T>
+struct vertex_format<T, true>
+{
+    using layout = VertexLayout<T>;
+};
+
+}
+
+//Retorna true se T possui um VertexLayout.
+template<typename T>
+struct is_interleaved : detail::is_interleaved<T> {};
                
 //Modelo de target ARRAY_BUFFER. 
 template<typename T>
-struct ArrayBuffer
+struct ArrayBuffer : detail::vertex_format<T>
 {
     static const GLenum target = GL_ARRAY_BUFFER;
-    static const GLint size = VertexTraits<T>::size;
-    static const GLenum type = VertexTraits<T>::type;
 };
 
 //Modelo de target ELEMENT_ARRAY. 
@@ -114,15 +277,309 @@ struct ElementArray
     static const GLenum GLtype{GLTypeTraits<T>::type};
 };
 
-//RAII para glBindBuffer.
+#ifdef GL_DRAW_INDIRECT_BUFFER
+//Modelo de target DRAW_INDIRECT_BUFFER(OpenGL 4.0). Armazena os
+//parâmetros de chamadas de desenho indiretas. Só é definido se o
+//loader expõe o OpenGL 4.0.
+template<typename T>
+struct DrawIndirectBuffer
+{
+    static const GLenum target = GL_DRAW_INDIRECT_BUFFER;
+    using type = T;
+};
+#endif
+
+//Modelo de target UNIFORM_BUFFER. Os elementos são copiados sem
+//conversão para blocos de uniformes, por isso T deve ter o layout
+//std140: um tipo glm equivalente(vec4, mat4, ...) ou uma estrutura
+//com UniformLayout(veja std140.hpp).
+template<typename T>
+struct UniformBuffer
+{
+    static_assert(is_std140<T>::value,
+                  "The type must match the std140 layout: specialize "
+                  "UniformLayout and pad the size to a multiple of 16 bytes");
+    static const GLenum target = GL_UNIFORM_BUFFER;
+    using type = T;
+};
+
+//Modelo de target PIXEL_PACK_BUFFER. Destino de glReadPixels e
+//glGetTexImage, ou seja, leitura de pixels sem bloquear o cliente.
+template<typename T>
+struct PixelPackBuffer
+{
+    static const GLenum target = GL_PIXEL_PACK_BUFFER;
+    using type = T;
+};
+
+//Modelo de target PIXEL_UNPACK_BUFFER. Origem de glTexSubImage*, ou
+//seja, envio de pixels para texturas.
+template<typename T>
+struct PixelUnpackBuffer
+{
+    static const GLenum target = GL_PIXEL_UNPACK_BUFFER;
+    using type = T;
+};
+
+//RAII para glBindBuffer. Restaura o buffer que estava ligado ao target.
 struct scoped_target_buffer_bind
 {
-    scoped_target_buffer_bind(GLenum target, GLuint id) : target(target)
-    { glBindBuffer(target, id); }
+    scoped_target_buffer_bind(GLenum target, GLuint id)
+        : target(target)
+        , previous(state().buffer(target))
+    { state().bind_buffer(target, id); }
     
-    ~scoped_target_buffer_bind() { glBindBuffer(target, 0); }
+    ~scoped_target_buffer_bind() { state().bind_buffer(target, previous); }
 
     GLenum target;
+    GLuint previous;
+};
+
+namespace detail {
+
+//Copia `size` bytes do offset `src` do buffer `src_id` para o offset
+//`dst` do buffer `dst_id`. Os intervalos não podem se sobrepor se os
+//buffers forem o mesmo.
+inline void copy_buffer(GLuint src_id, GLuint dst_id, std::size_t src,
+                        std::size_t dst, std::size_t size)
+{
+#ifdef FREIJO_DSA
+    glCopyNamedBufferSubData(src_id, dst_id, src, dst, size);
+#else
+    scoped_target_buffer_bind bbgr(GL_COPY_READ_BUFFER, src_id);
+    scoped_target_buffer_bind bbgw(GL_COPY_WRITE_BUFFER, dst_id);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, src,
+                        dst, size);
+#endif
+}
+
+//Buffer temporário de `size` bytes para cópias entre intervalos
+//sobrepostos de um mesmo buffer: o conteúdo é copiado para ele e de
+//volta, duas chamadas em vez de uma por pedaço.
+class scratch_buffer
+{
+public:
+    explicit scratch_buffer(std::size_t size)
+    {
+#ifdef FREIJO_DSA
+        glCreateBuffers(1, &_id);
+        glNamedBufferData(_id, size, nullptr, GL_STREAM_COPY);
+#else
+        glGenBuffers(1, &_id);
+        scoped_target_buffer_bind bbg(GL_COPY_WRITE_BUFFER, _id);
+        glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STREAM_COPY);
+#endif
+    }
+
+    ~scratch_buffer()
+    {
+        glDeleteBuffers(1, &_id);
+        state().buffer_deleted(_id);
+    }
+
+    scratch_buffer(const scratch_buffer&) = delete;
+    scratch_buffer& operator=(const scratch_buffer&) = delete;
+
+    GLuint id() const noexcept { return _id; }
+private:
+    GLuint _id{0};
+};
+
+//Copia `size` bytes de `src` para `dst` dentro do buffer `id`. Os
+//intervalos podem se sobrepor: glCopyBufferSubData não aceita
+//intervalos sobrepostos no mesmo buffer, então a cópia passa por um
+//buffer temporário(duas chamadas, independente da distância entre
+//`src` e `dst`).
+inline void copy_within(GLuint id, std::size_t src, std::size_t dst,
+                        std::size_t size)
+{
+    if(src == dst || size == 0) return;
+    auto gap = src > dst ? src - dst : dst - src;
+    if(gap >= size)
+    {
+        copy_buffer(id, id, src, dst, size);
+        return;
+    }
+    scratch_buffer scratch(size);
+    copy_buffer(id, scratch.id(), src, 0, size);
+    copy_buffer(scratch.id(), id, 0, dst, size);
+}
+
+}
+
+//Visão de um array contíguo(ponteiro e número de elementos) que não
+//é dono dos elementos. Constrói e redefine buffers sem cópias no
+//cliente, por exemplo a partir de um arquivo mapeado em memória(veja
+//mesh_file.hpp).
+template<typename T>
+struct view
+{
+    const T* data;
+    std::size_t size;
+
+    const T* begin() const noexcept { return data; }
+    const T* end() const noexcept { return data + size; }
+};
+
+template<typename T>
+inline view<T> make_view(const T* data, std::size_t size) noexcept
+{ return {data, size}; }
+
+namespace detail {
+
+//Ponteiro para o primeiro elemento de [first, last), nullptr se
+//vazio. Aceita iteradores que não são ponteiros, como os de
+//std::vector.
+template<typename ContiguousIt>
+inline auto data_of(ContiguousIt first, ContiguousIt last)
+    -> decltype(std::addressof(*first))
+{ return first == last ? nullptr : std::addressof(*first); }
+
+}
+
+/* Visão de um intervalo mapeado de um buffer(veja buffer::map_range),
+   com a interface de um span: data(), size(), begin(), end() e
+   operator[]. O intervalo é desmapeado pelo destrutor ou por unmap().
+
+   Se FREIJO_DSA não estiver definido o buffer é ligado a
+   COPY_WRITE_BUFFER durante flush() e unmap(), o que não altera o
+   estado do VAO ligado.
+
+   Modela o concept Movable.
+ */
+template<typename T>
+class mapped_view
+{
+public:
+    using value_type = T;
+    using iterator = T*;
+
+    /* poscondition: !*this */
+    mapped_view() = default;
+
+    mapped_view(GLuint id, T* data, std::size_t size,
+                GLbitfield flags) noexcept
+        : _id(id)
+        , _data(data)
+        , _size(data ? size : 0)
+        , _flags(flags)
+    {}
+
+    mapped_view(const mapped_view&) = delete;
+    mapped_view& operator=(const mapped_view&) = delete;
+
+    /* poscondition: rhs assume estado de mapped_view(). */
+    mapped_view(mapped_view&& rhs) noexcept
+    { swap(*this, rhs); }
+
+    mapped_view& operator=(mapped_view&& rhs) noexcept
+    {
+        swap(*this, rhs);
+        return *this;
+    }
+
+    friend void swap(mapped_view& a, mapped_view& b) noexcept
+    {
+        std::swap(a._id, b._id);
+        std::swap(a._data, b._data);
+        std::swap(a._size, b._size);
+        std::swap(a._flags, b._flags);
+    }
+
+    ~mapped_view() { unmap(); }
+
+    /* Torna visíveis para a GPU as escritas nos elementos
+     * [first, first + count) da visão.
+     *
+     * precondition: *this && o intervalo foi mapeado com
+     *               GL_MAP_FLUSH_EXPLICIT_BIT &&
+     *               first + count <= size().
+     */
+    void flush(std::size_t first, std::size_t count) const
+    {
+        assert(*this && (_flags & GL_MAP_FLUSH_EXPLICIT_BIT));
+        assert(first + count <= _size);
+#ifdef FREIJO_DSA
+        glFlushMappedNamedBufferRange(_id, first * sizeof(T),
+                                      count * sizeof(T));
+#else
+        scoped_target_buffer_bind bbg(GL_COPY_WRITE_BUFFER, _id);
+        glFlushMappedBufferRange(GL_COPY_WRITE_BUFFER, first * sizeof(T),
+                                 count * sizeof(T));
+#endif
+    }
+
+    /* Torna visíveis para a GPU todas as escritas da visão. */
+    void flush() const { flush(0, _size); }
+
+    /* Desmapeia o intervalo.
+     *
+     * poscondition: !*this
+     *
+     * /return false se o conteúdo foi corrompido ou se não estiver
+     *         mapeado.
+     */
+    GLboolean unmap() noexcept
+    {
+        if (!_data) return GL_FALSE;
+#ifdef FREIJO_DSA
+        auto res = glUnmapNamedBuffer(_id);
+#else
+        scoped_target_buffer_bind bbg(GL_COPY_WRITE_BUFFER, _id);
+        auto res = glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+#endif
+        _data = nullptr;
+        _size = 0;
+        return res;
+    }
+
+    /* Retorna true se o intervalo está mapeado. */
+    explicit operator bool() const noexcept { return _data != nullptr; }
+
+    T* data() const noexcept { return _data; }
+    std::size_t size() const noexcept { return _size; }
+    bool empty() const noexcept { return _size == 0; }
+    T* begin() const noexcept { return _data; }
+    T* end() const noexcept { return _data + _size; }
+
+    T& operator[](std::size_t i) const noexcept
+    {
+        assert(i < _size);
+        return _data[i];
+    }
+
+    GLbitfield flags() const noexcept { return _flags; }
+private:
+    GLuint _id{0};
+    T* _data{nullptr};
+    std::size_t _size{0};
+    GLbitfield _flags{0};
+};
+
+/* Política de atualização de um intervalo do buffer(veja
+   buffer::update). Escrever em um buffer que a GPU ainda está lendo
+   obriga o driver a esperar a GPU ou a copiar os dados.
+
+   sub_data -> glBufferSubData. O driver pode sincronizar com a GPU.
+   orphan -> glBufferData(nullptr) seguido de glBufferSubData. O
+             driver aloca uma nova área e a GPU continua lendo a
+             antiga. Somente para a escrita do buffer inteiro.
+   invalidate -> glInvalidateBufferSubData(OpenGL 4.3) seguido de
+                 glBufferSubData. O conteúdo anterior do intervalo é
+                 descartado, o resto do buffer é preservado. Sem
+                 OpenGL 4.3 equivale a orphan quando o buffer inteiro
+                 é escrito e a sub_data caso contrário.
+   unsynchronized -> glMapBufferRange com GL_MAP_UNSYNCHRONIZED_BIT.
+                     Não há sincronização alguma, o cliente deve
+                     garantir com um fence que a GPU não lê mais o
+                     intervalo.
+ */
+enum class update_policy
+{
+    sub_data,
+    orphan,
+    invalidate,
+    unsynchronized
 };
 
 /* buffer é um objeto OpenGL que armazena um array de elementos
@@ -134,10 +591,17 @@ struct scoped_target_buffer_bind
    Seção 2.9.1
    https://khronos.org/registry/OpenGL/specs/gl/glspec33.core.pdf
 
+   Se FREIJO_DSA estiver definido as operações utilizam Direct State
+   Access (OpenGL 4.5 ou ARB_direct_state_access), ou seja, não
+   alteram o buffer ligado ao target.
+
    /tparam ValueType Tipo do elemento armazenado no buffer.
    /tparam Target Define a finalidade de uso do buffer:
                   ARRAY_BUFFER -> Atributos de vértices.
                   ELEMENT_ARRAY_BUFFER -> Índices de vértices.
+                  UNIFORM_BUFFER -> Blocos de uniformes(std140).
+                  PIXEL_PACK_BUFFER -> Leitura de pixels.
+                  PIXEL_UNPACK_BUFFER -> Envio de pixels.
 
    Modela o concept Regular.
  */
@@ -156,24 +620,37 @@ public:
      * /param c container.
      * /param usage Dica de uso do buffer. Ver especificação do OpenGL.
      */
-    buffer(std::vector<value_type> c,
+    buffer(const std::vector<value_type>& c,
                  GLenum usage = GL_DYNAMIC_DRAW)
     {
         _size = c.size();
         alloc_cpy_buffer(c.data(), usage); 
     }
 
+    /* Aloca um buffer com a cópia dos elementos de v, sem cópias
+     * intermediárias no cliente.
+     *
+     * /param v Ponteiro e número de elementos.
+     * /param usage Dica de uso do buffer. Ver especificação do OpenGL.
+     */
+    buffer(view<value_type> v,
+                 GLenum usage = GL_DYNAMIC_DRAW)
+    {
+        _size = v.size;
+        alloc_cpy_buffer(v.data, usage);
+    }
+
     /* Aloca um buffer com a cópia de std::array<value_type, N>.
      *
      * /param c container.
      * /param usage Dica de uso do buffer. Ver especificação do OpenGL.
      */
     template<std::size_t N>
-    buffer(std::array<value_type, N> c,
+    buffer(const std::array<value_type, N>& c,
                  GLenum usage = GL_DYNAMIC_DRAW)
     {
         _size = c.size();
-        alloc_cpy_buffer(c.begin(), usage); 
+        alloc_cpy_buffer(c.data(), usage); 
     }
     
     /* Aloca um buffer com a cópia de [first, last).
@@ -191,7 +668,7 @@ public:
                  GLenum usage = GL_DYNAMIC_DRAW)
     {
         _size = std::distance(first, last);
-        alloc_cpy_buffer(first, usage); 
+        alloc_cpy_buffer(detail::data_of(first, last), usage); 
     }
     
     /* Aloca um buffer como cópia de uma std::initializer_list<value_type.
@@ -269,12 +746,26 @@ public:
      *
      * precondition: o buffer não está mapeado(map). 
      */
-    void reset(std::vector<value_type> c,
+    void reset(const std::vector<value_type>& c,
                GLenum usage = GL_DYNAMIC_DRAW)
     {
         reset(c.data(), c.data() + c.size(), usage); 
     }
 
+    /* Redefine o conteúdo do buffer com os elementos de v.
+     *
+     * Se v.size == size() o conteúdo de v sobrescreve o conteúdo do buffer,
+     * caso contrário há uma realocação do espaço seguida de uma cópia do
+     * conteúdo de v.
+     *
+     * precondition: o buffer não está mapeado(map).
+     */
+    void reset(view<value_type> v,
+               GLenum usage = GL_DYNAMIC_DRAW)
+    {
+        reset(v.begin(), v.end(), usage);
+    }
+
     /* Redefine o conteúdo do buffer.
      * 
      * Se c.size() == size() o conteúdo de c sobrescreve o conteúdo do buffer,
@@ -284,10 +775,10 @@ public:
      * precondition: o buffer não está mapeado(map). 
      */
     template<std::size_t N>
-    void reset(std::array<value_type, N> c,
+    void reset(const std::array<value_type, N>& c,
                GLenum usage = GL_DYNAMIC_DRAW)
     {
-        reset(c.begin(), c.begin() + c.size(), usage); 
+        reset(c.data(), c.data() + c.size(), usage); 
     }
     
     /* Redefine o conteúdo do buffer.
@@ -302,15 +793,106 @@ public:
     void reset(ContiguousIt first, ContiguousIt last,
                GLenum usage = GL_DYNAMIC_DRAW)
     {
-        auto nsize = std::distance(first, last);
+        std::size_t nsize = std::distance(first, last);
         if (nsize == _size)
-            glBufferSubData(target::target, 0, area(), first);
+            update(first, last, 0, update_policy::sub_data);
         else
         {
             del_buffer();
             _size = nsize;
-            alloc_cpy_buffer(first, usage);
+            alloc_cpy_buffer(detail::data_of(first, last), usage);
+        }
+    }
+
+    /* Sobrescreve os elementos [offset, offset + (last - first)) com
+     * [first, last) segundo a política `policy`(veja update_policy).
+     * Nenhuma realocação é feita e o nome do buffer não muda.
+     *
+     * precondition: offset + (last - first) <= size() && o buffer não
+     *               está mapeado(map) &&
+     *               (policy != orphan || o buffer inteiro é escrito).
+     */
+    template<typename ContiguousIt>
+    void update(ContiguousIt first, ContiguousIt last,
+                std::size_t offset = 0,
+                update_policy policy = update_policy::sub_data)
+    {
+        std::size_t count = std::distance(first, last);
+        assert(offset + count <= _size);
+        if (count == 0) return;
+        auto bytes = count * sizeof(value_type);
+        auto start = offset * sizeof(value_type);
+        bool whole = bytes == area();
+        assert(policy != update_policy::orphan || whole);
+        //glInvalidateBufferSubData é do OpenGL 4.3: não é declarado por
+        //um loader anterior e o ponteiro da função é nulo num contexto
+        //anterior.
+#ifdef GL_VERSION_4_3
+        if (policy == update_policy::invalidate && state().version() < 43)
+#else
+        if (policy == update_policy::invalidate)
+#endif
+            policy = whole ? update_policy::orphan : update_policy::sub_data;
+#ifdef FREIJO_DSA
+        switch (policy)
+        {
+        case update_policy::orphan:
+            glNamedBufferData(_id, area(), nullptr, _usage);
+            break;
+#ifdef GL_VERSION_4_3
+        case update_policy::invalidate:
+            glInvalidateBufferSubData(_id, start, bytes);
+            break;
+#endif
+        case update_policy::unsynchronized:
+            write_unsynchronized(glMapNamedBufferRange(
+                _id, start, bytes, unsynchronized_access), &*first, bytes);
+            glUnmapNamedBuffer(_id);
+            return;
+        default:
+            break;
+        }
+        glNamedBufferSubData(_id, start, bytes, &*first);
+#else
+        //COPY_WRITE_BUFFER não faz parte do estado do VAO, ao contrário
+        //de ELEMENT_ARRAY_BUFFER.
+        scoped_target_buffer_bind bbg(GL_COPY_WRITE_BUFFER, _id);
+        switch (policy)
+        {
+        case update_policy::orphan:
+            glBufferData(GL_COPY_WRITE_BUFFER, area(), nullptr, _usage);
+            break;
+#ifdef GL_VERSION_4_3
+        case update_policy::invalidate:
+            glInvalidateBufferSubData(_id, start, bytes);
+            break;
+#endif
+        case update_policy::unsynchronized:
+            write_unsynchronized(glMapBufferRange(
+                GL_COPY_WRITE_BUFFER, start, bytes, unsynchronized_access),
+                &*first, bytes);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            return;
+        default:
+            break;
         }
+        glBufferSubData(GL_COPY_WRITE_BUFFER, start, bytes, &*first);
+#endif
+    }
+
+    /* Escrita sem sincronização após a espera de `guard`, o fence
+     * inserido(fence::set) depois dos comandos que leem o intervalo.
+     * O cliente só bloqueia se a GPU ainda não os concluiu.
+     *
+     * precondition: offset + (last - first) <= size() && o buffer não
+     *               está mapeado(map).
+     */
+    template<typename ContiguousIt>
+    void update(ContiguousIt first, ContiguousIt last,
+                std::size_t offset, const fence& guard)
+    {
+        guard.wait();
+        update(first, last, offset, update_policy::unsynchronized);
     }
 
     /* Retorna um ponteiro para value_type para o começo do buffer.
@@ -328,12 +910,44 @@ public:
     value_type* map(GLenum access) const
     {
         assert(*this != buffer());
+#ifdef FREIJO_DSA
+        return reinterpret_cast<value_type*>(glMapNamedBuffer(_id, access));
+#else
         scoped_target_buffer_bind bbg(target::target, _id);
         auto p = reinterpret_cast<value_type*>
             (glMapBuffer(target::target, access));
         return p;
+#endif
     }
     
+    /* Mapeia os elementos [offset, offset + count) com
+     * glMapBufferRange. Somente o intervalo é transferido, ao contrário
+     * de map.
+     *
+     * precondition: offset + count <= size() && o buffer não está
+     *               mapeado.
+     *
+     * /param flags GL_MAP_READ_BIT e/ou GL_MAP_WRITE_BIT combinados
+     *              com GL_MAP_INVALIDATE_RANGE_BIT,
+     *              GL_MAP_UNSYNCHRONIZED_BIT ou
+     *              GL_MAP_FLUSH_EXPLICIT_BIT(veja mapped_view::flush).
+     * /return Visão do intervalo, vazia(!view) se o mapeamento falhar.
+     */
+    mapped_view<value_type> map_range(std::size_t offset, std::size_t count,
+                                      GLbitfield flags) const
+    {
+        assert(offset + count <= _size);
+        auto start = offset * sizeof(value_type);
+        auto bytes = count * sizeof(value_type);
+#ifdef FREIJO_DSA
+        auto p = glMapNamedBufferRange(_id, start, bytes, flags);
+#else
+        scoped_target_buffer_bind bbg(GL_COPY_WRITE_BUFFER, _id);
+        auto p = glMapBufferRange(GL_COPY_WRITE_BUFFER, start, bytes, flags);
+#endif
+        return {_id, reinterpret_cast<value_type*>(p), count, flags};
+    }
+
     /* Invalida o mapeamento do buffer.
      * 
      * precondition: this != buffer() 
@@ -344,18 +958,42 @@ public:
     GLboolean unmap() const
     {
         assert(*this != buffer());
+#ifdef FREIJO_DSA
+        return glUnmapNamedBuffer(_id);
+#else
         scoped_target_buffer_bind bbg(target::target, _id);
         auto res = glUnmapBuffer(target::target);
         return res;
+#endif
     }
 
     void bind() const
-    { glBindBuffer(target::target, _id); }
+    { state().bind_buffer(target::target, _id); }
 
     void unbind() const
-    { glBindBuffer(target::target, 0); }
-    
-    /* Número de elementos alocados. */    
+    { state().bind_buffer(target::target, 0); }
+
+    /* Liga o buffer ao ponto de ligação `index` de um target indexado
+       (UNIFORM_BUFFER, TRANSFORM_FEEDBACK_BUFFER, ...).
+     */
+    void bind_base(GLuint index) const
+    { state().bind_buffer_base(target::target, index, _id); }
+
+    /* Liga os elementos [first, first + count) ao ponto de ligação
+       `index` de um target indexado.
+
+       precondition: o offset first * sizeof(value_type) é múltiplo
+                     de GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT para
+                     UNIFORM_BUFFER.
+     */
+    void bind_range(GLuint index, std::size_t first, std::size_t count) const
+    {
+        state().bind_buffer_range(target::target, index, _id,
+                                  first * sizeof(value_type),
+                                  count * sizeof(value_type));
+    }
+
+    /* Número de elementos alocados. */
     std::size_t size() const noexcept {return _size;}
     
     /* Retorna true se o buffer estiver vazio. */    
@@ -371,6 +1009,14 @@ private:
     std::size_t _size{0};
     GLenum _usage{GL_DYNAMIC_DRAW};
     
+    static const GLbitfield unsynchronized_access{
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT
+        | GL_MAP_UNSYNCHRONIZED_BIT};
+
+    static void write_unsynchronized(void* dst, const void* src,
+                                     std::size_t bytes)
+    { if (dst) std::memcpy(dst, src, bytes); }
+
     /* Área ocupada pelo buffer em bytes */
     std::size_t area() const noexcept { return sizeof(value_type) * _size; }
         
@@ -379,16 +1025,20 @@ private:
         alloc_cpy_buffer(nullptr, usage);
     }
 
-    template<typename ContiguousIt>
-    void alloc_cpy_buffer(ContiguousIt first, GLenum usage)
+    void alloc_cpy_buffer(const value_type* first, GLenum usage)
     {
         _usage = usage;
+#ifdef FREIJO_DSA
+        glCreateBuffers(1, &_id);
+        glNamedBufferData(_id, area(), first, _usage);
+#else
         glGenBuffers(1, &_id);
         scoped_target_buffer_bind bbg(target::target, _id);
         glBufferData(target::target,
                      area(),
                      first,
                      _usage);
+#endif
     }
 
     template<typename buffer>
@@ -396,15 +1046,23 @@ private:
     {
         _size = o.size();
         alloc_buffer(o._usage);
+#ifdef FREIJO_DSA
+        glCopyNamedBufferSubData(o._id, _id, 0, 0, o.area());
+#else
         scoped_target_buffer_bind bbgr(GL_COPY_READ_BUFFER, o._id);
         scoped_target_buffer_bind bbgw(GL_COPY_WRITE_BUFFER, _id);
         glCopyBufferSubData(GL_COPY_READ_BUFFER,
                             GL_COPY_WRITE_BUFFER,
                             0, 0,
                             o.area());
+#endif
     }
 
-    void del_buffer() { glDeleteBuffers(1, &_id); }
+    void del_buffer()
+    {
+        glDeleteBuffers(1, &_id);
+        state().buffer_deleted(_id);
+    }
 };
 
 template<typename T, typename Target>
@@ -432,18 +1090,33 @@ using VBO = buffer<ValueType, ArrayBuffer<ValueType>>;
 template<typename ValueType>
 using EBO = buffer<ValueType, ElementArray<ValueType>>;
 
+//Alias template para instanciação de um UBO(Uniform Buffer Object).
+template<typename ValueType>
+using UBO = buffer<ValueType, UniformBuffer<ValueType>>;
+
+//Alias templates para instanciação de PBOs(Pixel Buffer Objects).
+template<typename ValueType>
+using PBO_pack = buffer<ValueType, PixelPackBuffer<ValueType>>;
+
+template<typename ValueType>
+using PBO_unpack = buffer<ValueType, PixelUnpackBuffer<ValueType>>;
+
+//RAII para bind()/unbind(). Restaura o buffer que estava ligado ao target.
 template<typename buffer>
 class scoped_buffer_bind
 {
 public:
     scoped_buffer_bind(const buffer& pbuffer)
-        : _buffer(pbuffer)
-    { _buffer.bind(); }
+        : _previous(state().buffer(buffer::target::target))
+    { pbuffer.bind(); }
 
     ~scoped_buffer_bind()
-    { _buffer.unbind(); }
+    { state().bind_buffer(buffer::target::target, _previous); }
+
+    scoped_buffer_bind(const scoped_buffer_bind&) = delete;
+    scoped_buffer_bind& operator=(const scoped_buffer_bind&) = delete;
 private:
-    const buffer& _buffer;
+    GLuint _previous;
 };
 
 }
@@ -0,0 +1,372 @@
+
+// Copyright Ricardo Calheiros de Miranda Cosme 2017.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "freijo/buffer.hpp"
+#include "freijo/state.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <new>
+#include <vector>
+
+namespace freijo {
+
+class buffer_arena;
+
+/// Typed handle to a range of elements inside a buffer_arena
+///
+/// A slice is usable where a buffer is expected by VAO::attach and
+/// the draw helpers. Attaching a slice attaches the whole buffer of
+/// the arena, so one VAO serves all the slices of an arena with the
+/// same layout and each draw selects its vertices through a base
+/// vertex(`first()`) and its indices through an offset(`offset()`).
+///
+/// The offset of a slice can change after
+/// buffer_arena::defragment(), it must not be cached.
+///
+/// /tparam ValueType Type of the element stored in the slice.
+/// /tparam Target Purpose of the slice (see buffer).
+///
+/// Model the concept Regular.
+///
+template<typename ValueType, typename Target>
+class buffer_slice
+{
+public:
+    using value_type = ValueType;
+    using target = Target;
+
+    buffer_slice() = default;
+
+    /// Write the elements [first, last) starting at the element `pos`
+    ///
+    /// precondition: pos + distance(first, last) <= size()
+    ///
+    template<typename ContiguousIt>
+    void write(ContiguousIt first, ContiguousIt last, std::size_t pos = 0);
+
+    void bind() const
+    { state().bind_buffer(target::target, id()); }
+
+    void unbind() const
+    { state().bind_buffer(target::target, 0); }
+
+    /// Number of elements of the slice
+    std::size_t size() const noexcept { return _size; }
+
+    /// Return true if the slice is empty
+    bool empty() const noexcept { return _size == 0; }
+
+    /// Offset in bytes of the slice in the arena's buffer
+    std::size_t offset() const;
+
+    /// Index of the first element of the slice in the arena's
+    /// buffer, e.g. the base vertex of a draw.
+    std::size_t first() const
+    { return offset() / sizeof(value_type); }
+
+    /// Return the name of the arena's buffer
+    GLuint id() const;
+
+    friend bool operator==(const buffer_slice& lhs, const buffer_slice& rhs)
+    { return lhs._arena == rhs._arena && lhs._handle == rhs._handle; }
+
+    friend bool operator!=(const buffer_slice& lhs, const buffer_slice& rhs)
+    { return !(lhs == rhs); }
+private:
+    friend class buffer_arena;
+
+    buffer_slice(buffer_arena* arena, std::uint32_t handle,
+                 std::size_t size)
+        : _arena(arena)
+        , _handle(handle)
+        , _size(size)
+    {}
+
+    buffer_arena* _arena{nullptr};
+    std::uint32_t _handle{0};
+    std::size_t _size{0};
+};
+
+/// Alias template to a slice of vertex attributes
+template<typename ValueType>
+using VBO_slice = buffer_slice<ValueType, ArrayBuffer<ValueType>>;
+
+/// Alias template to a slice of indices
+template<typename ValueType>
+using EBO_slice = buffer_slice<ValueType, ElementArray<ValueType>>;
+
+/// One large buffer object sub-allocated in slices
+///
+/// Many small meshes share one buffer name, and therefore one VAO,
+/// instead of one buffer each. The free space is kept in a free-list
+/// of ranges ordered by offset, an allocation takes the first range
+/// that fits(first-fit) and a deallocation coalesces the range with
+/// its neighbours. The offsets are aligned to sizeof(value_type), so
+/// the base vertex of a slice is always an integer.
+///
+/// defragment() compacts the slices to the beginning of the buffer
+/// with glCopyBufferSubData through a scratch buffer. The slices keep
+/// their handles, only their offsets change.
+///
+/// The arena is neither copyable nor movable because the slices
+/// refer to it.
+///
+class buffer_arena
+{
+public:
+    /// Allocate a buffer of `capacity` bytes.
+    ///
+    /// /param capacity Size in bytes of the buffer.
+    /// /param usage Usage hint of the buffer (see the OpenGL specification).
+    ///
+    explicit buffer_arena(std::size_t capacity,
+                          GLenum usage = GL_STATIC_DRAW)
+        : _capacity(capacity)
+    {
+#ifdef FREIJO_DSA
+        glCreateBuffers(1, &_id);
+        glNamedBufferData(_id, _capacity, nullptr, usage);
+#else
+        glGenBuffers(1, &_id);
+        scoped_target_buffer_bind bbg(GL_COPY_WRITE_BUFFER, _id);
+        glBufferData(GL_COPY_WRITE_BUFFER, _capacity, nullptr, usage);
+#endif
+        if(_capacity) _free.emplace(0, _capacity);
+    }
+
+    ~buffer_arena()
+    {
+        glDeleteBuffers(1, &_id);
+        state().buffer_deleted(_id);
+    }
+
+    buffer_arena(const buffer_arena&) = delete;
+    buffer_arena& operator=(const buffer_arena&) = delete;
+
+    /// Allocate a slice of `count` elements.
+    ///
+    /// poscondition: the content of the slice is undefined.
+    ///
+    /// /throw std::bad_alloc if there isn't a free range that fits
+    ///
+    template<typename Slice>
+    Slice allocate(std::size_t count)
+    {
+        using value_type = typename Slice::value_type;
+        auto handle = reserve(count * sizeof(value_type),
+                              sizeof(value_type));
+        return Slice(this, handle, count);
+    }
+
+    /// Allocate a slice with the copy of [first, last).
+    ///
+    /// /throw std::bad_alloc if there isn't a free range that fits
+    ///
+    template<typename Slice, typename ContiguousIt>
+    Slice allocate(ContiguousIt first, ContiguousIt last)
+    {
+        auto slice = allocate<Slice>(std::distance(first, last));
+        slice.write(first, last);
+        return slice;
+    }
+
+    /// Return the range of the slice to the free-list.
+    ///
+    /// precondition: `slice` was allocated by this arena.
+    ///
+    template<typename Slice>
+    void deallocate(const Slice& slice)
+    {
+        assert(slice._arena == this);
+        auto& b = _blocks[slice._handle];
+        release(b.offset, b.size);
+        b.live = false;
+        _unused.push_back(slice._handle);
+    }
+
+    /// Move all the slices to the beginning of the buffer, leaving a
+    /// single free range at the end.
+    ///
+    /// The moved slices are copied to a scratch buffer at their new
+    /// offsets and then back in one copy, so the cost doesn't depend
+    /// on the distance of the moves. The slices that don't move, at
+    /// the beginning of the buffer, aren't copied.
+    void defragment()
+    {
+        std::vector<std::uint32_t> order;
+        for(std::uint32_t h{0}; h < _blocks.size(); ++h)
+            if(_blocks[h].live) order.push_back(h);
+        std::sort(order.begin(), order.end(),
+                  [this](std::uint32_t a, std::uint32_t b)
+                  { return _blocks[a].offset < _blocks[b].offset; });
+
+        // New offsets; [start, end) is the range that changes.
+        std::vector<std::size_t> offsets;
+        std::size_t start{0}, end{0};
+        for(auto h : order)
+        {
+            auto& b = _blocks[h];
+            auto offset = align(end, b.alignment);
+            if(offset == b.offset && start == end) start = offset + b.size;
+            offsets.push_back(offset);
+            end = offset + b.size;
+        }
+        if(start < end)
+        {
+            detail::scratch_buffer scratch(end - start);
+            // Adjacent slices that stay adjacent are copied together.
+            std::size_t src{0}, dst{0}, size{0};
+            for(std::size_t i{0}; i < order.size(); ++i)
+            {
+                auto& b = _blocks[order[i]];
+                if(offsets[i] < start) continue;
+                if(size && src + size == b.offset && dst + size == offsets[i])
+                {
+                    size += b.size;
+                    continue;
+                }
+                if(size)
+                    detail::copy_buffer(_id, scratch.id(), src, dst - start,
+                                        size);
+                src = b.offset;
+                dst = offsets[i];
+                size = b.size;
+            }
+            if(size)
+                detail::copy_buffer(_id, scratch.id(), src, dst - start, size);
+            detail::copy_buffer(scratch.id(), _id, 0, start, end - start);
+        }
+        for(std::size_t i{0}; i < order.size(); ++i)
+            _blocks[order[i]].offset = offsets[i];
+        _free.clear();
+        if(end < _capacity) _free.emplace(end, _capacity - end);
+    }
+
+    /// Size in bytes of the buffer
+    std::size_t capacity() const noexcept { return _capacity; }
+
+    /// Number of free bytes, maybe fragmented.
+    std::size_t available() const noexcept
+    {
+        std::size_t n{0};
+        for(auto& r : _free) n += r.second;
+        return n;
+    }
+
+    /// Return the buffer's name
+    GLuint id() const noexcept { return _id; }
+
+    /// Offset in bytes of the slice identified by `handle`
+    std::size_t offset(std::uint32_t handle) const
+    { return _blocks[handle].offset; }
+private:
+    struct block
+    {
+        std::size_t offset;
+        std::size_t size;
+        std::size_t alignment;
+        bool live;
+    };
+
+    GLuint _id{0};
+    std::size_t _capacity{0};
+
+    // Free ranges(offset -> size) ordered by offset
+    std::map<std::size_t, std::size_t> _free;
+
+    // Allocations indexed by the handles of the slices
+    std::vector<block> _blocks;
+    std::vector<std::uint32_t> _unused;
+
+    static std::size_t align(std::size_t offset, std::size_t alignment)
+    { return (offset + alignment - 1) / alignment * alignment; }
+
+    std::uint32_t reserve(std::size_t size, std::size_t alignment)
+    {
+        for(auto it = _free.begin(); it != _free.end(); ++it)
+        {
+            auto begin = it->first;
+            auto end = begin + it->second;
+            auto offset = align(begin, alignment);
+            if(offset + size > end) continue;
+
+            _free.erase(it);
+            if(offset > begin) _free.emplace(begin, offset - begin);
+            if(offset + size < end)
+                _free.emplace(offset + size, end - offset - size);
+
+            block b{offset, size, alignment, true};
+            if(_unused.empty())
+            {
+                _blocks.push_back(b);
+                return _blocks.size() - 1;
+            }
+            auto handle = _unused.back();
+            _unused.pop_back();
+            _blocks[handle] = b;
+            return handle;
+        }
+        throw std::bad_alloc();
+    }
+
+    void release(std::size_t offset, std::size_t size)
+    {
+        if(!size) return;
+        auto next = _free.lower_bound(offset);
+        if(next != _free.end() && offset + size == next->first)
+        {
+            size += next->second;
+            next = _free.erase(next);
+        }
+        if(next != _free.begin())
+        {
+            auto prev = std::prev(next);
+            if(prev->first + prev->second == offset)
+            {
+                prev->second += size;
+                return;
+            }
+        }
+        _free.emplace(offset, size);
+    }
+
+};
+
+template<typename ValueType, typename Target>
+inline std::size_t buffer_slice<ValueType, Target>::offset() const
+{ return _arena->offset(_handle); }
+
+template<typename ValueType, typename Target>
+inline GLuint buffer_slice<ValueType, Target>::id() const
+{ return _arena->id(); }
+
+template<typename ValueType, typename Target>
+template<typename ContiguousIt>
+inline void buffer_slice<ValueType, Target>::write(ContiguousIt first,
+                                                   ContiguousIt last,
+                                                   std::size_t pos)
+{
+    std::size_t count = std::distance(first, last);
+    assert(pos + count <= _size);
+    if(!count) return;
+    auto offset = this->offset() + pos * sizeof(value_type);
+    auto bytes = count * sizeof(value_type);
+#ifdef FREIJO_DSA
+    glNamedBufferSubData(id(), offset, bytes, &*first);
+#else
+    scoped_target_buffer_bind bbg(GL_COPY_WRITE_BUFFER, id());
+    glBufferSubData(GL_COPY_WRITE_BUFFER, offset, bytes, &*first);
+#endif
+}
+
+}
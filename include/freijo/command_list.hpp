@@ -0,0 +1,386 @@
+
+// Copyright Ricardo Calheiros de Miranda Cosme 2017.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "freijo/buffer_arena.hpp"
+#include "freijo/render_queue.hpp"
+#include "freijo/state.hpp"
+#include "freijo/std140.hpp"
+#include "freijo/stream_buffer.hpp"
+#include "freijo/uniform_ring.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+namespace freijo {
+
+namespace detail {
+
+// Linear allocator used by a single thread. clear() keeps the blocks,
+// so an arena refilled every frame stops allocating after the first
+// frames.
+class linear_arena
+{
+public:
+    explicit linear_arena(std::size_t block)
+        : _block(block)
+    {}
+
+    // precondition: alignment <= alignof(std::max_align_t)
+    unsigned char* allocate(std::size_t bytes, std::size_t alignment)
+    {
+        assert(alignment <= alignof(std::max_align_t));
+        for(;; ++_current, _used = 0)
+        {
+            if(_current == _blocks.size())
+            {
+                auto size = std::max(_block, bytes);
+                _blocks.push_back(block{
+                    std::unique_ptr<unsigned char[]>(new unsigned char[size]),
+                    size});
+            }
+            auto& b = _blocks[_current];
+            auto offset = align_up(_used, alignment);
+            if(offset + bytes <= b.size)
+            {
+                _used = offset + bytes;
+                return b.data.get() + offset;
+            }
+        }
+    }
+
+    void clear() noexcept
+    {
+        _current = 0;
+        _used = 0;
+    }
+
+    // Number of bytes allocated from the system
+    std::size_t capacity() const noexcept
+    {
+        std::size_t n{0};
+        for(auto& b : _blocks) n += b.size;
+        return n;
+    }
+private:
+    struct block
+    {
+        std::unique_ptr<unsigned char[]> data;
+        std::size_t size;
+    };
+
+    std::size_t _block;
+    std::vector<block> _blocks;
+    std::size_t _current{0};
+    std::size_t _used{0};
+};
+
+// Target of the ring of uniform blocks of any type
+struct uniform_block_target
+{
+    static const GLenum target = GL_UNIFORM_BUFFER;
+};
+
+}
+
+/// Sequence of commands recorded without OpenGL calls, to be
+/// submitted later by a command_queue on the thread of the context
+///
+/// A list records buffer updates, uniform blocks and draws. The data
+/// of the updates and of the blocks is copied to an arena owned by the
+/// list, so each worker thread records its own list without locks nor
+/// access to the context. clear() keeps the memory of the arena for
+/// the next frame.
+///
+/// Example:
+///
+///   std::vector<freijo::command_list> lists(workers);
+///   //worker i
+///   auto& list = lists[i];
+///   list.clear();
+///   for(auto& o : visible(i))
+///   {
+///       list.uniform(1, o.constants); //layout(binding = 1)
+///       list.draw_elements(state, GL_TRIANGLES, o.indices, o.vertices);
+///   }
+///   //context thread, after the workers finished
+///   queue.submit(lists.begin(), lists.end());
+///
+/// The buffers, programs and VAOs referenced by a list must live until
+/// it's submitted.
+///
+/// Model the concept Movable.
+///
+class command_list
+{
+public:
+    /// /param block Number of bytes of each block of the arena.
+    explicit command_list(std::size_t block = 1 << 16)
+        : _arena(block)
+    {}
+
+    command_list(command_list&&) = default;
+    command_list& operator=(command_list&&) = default;
+
+    /// Write [first, last) to `buf` starting at the element `offset`
+    /// when the list is submitted.
+    ///
+    /// /param first Iterator to the first element
+    ///              (models ContiguousIterator).
+    ///
+    /// precondition: offset + distance(first, last) <= buf.size()
+    template<typename Buffer, typename ContiguousIt>
+    void update(const Buffer& buf, ContiguousIt first, ContiguousIt last,
+                std::size_t offset = 0)
+    {
+        using value_type = typename Buffer::value_type;
+        std::size_t n = std::distance(first, last);
+        assert(offset + n <= buf.size());
+        write(kind::update, buf.id(), offset * sizeof(value_type),
+              &*first, n * sizeof(value_type), alignof(value_type));
+    }
+
+    /// Write [first, last) to the slice `buf` starting at the element
+    /// `offset` when the list is submitted.
+    template<typename T, typename Target, typename ContiguousIt>
+    void update(const buffer_slice<T, Target>& buf, ContiguousIt first,
+                ContiguousIt last, std::size_t offset = 0)
+    {
+        std::size_t n = std::distance(first, last);
+        assert(offset + n <= buf.size());
+        write(kind::update, buf.id(), buf.offset() + offset * sizeof(T),
+              &*first, n * sizeof(T), alignof(T));
+    }
+
+    /// Bind a copy of `block` to the uniform block binding point
+    /// `index` for the next draws.
+    ///
+    /// /tparam T Type of the block, it must match the std140 layout
+    ///           (see UniformBuffer).
+    template<typename T>
+    void uniform(GLuint index, const T& block)
+    {
+        static_assert(is_std140<T>::value,
+                      "The type must match the std140 layout: specialize "
+                      "UniformLayout and pad the size to a multiple of 16 "
+                      "bytes");
+        write(kind::uniform, index, 0, &block, sizeof(T), alignof(T));
+    }
+
+    void draw(const render_command& cmd)
+    {
+        _order.push_back(entry{kind::draw, _draws.size()});
+        _draws.push_back(cmd);
+    }
+
+    /// glDrawArrays with all the vertices of `vbo`
+    template<typename VBO>
+    void draw_arrays(const render_state& s, GLenum mode, const VBO& vbo,
+                     GLsizei instances = 1)
+    { draw(detail::arrays_command(s, mode, vbo, instances)); }
+
+    /// glDrawElements with all the indices of `ebo`
+    ///
+    /// precondition: `ebo` is attached to the VAO
+    template<typename EBO>
+    void draw_elements(const render_state& s, GLenum mode, const EBO& ebo,
+                       GLsizei instances = 1)
+    { draw(detail::elements_command(s, mode, ebo, instances)); }
+
+    /// glDrawElementsBaseVertex with the indices of `ebo`, relative to
+    /// the first vertex of `vbo`
+    ///
+    /// precondition: the arenas of `ebo` and `vbo` are attached to the
+    ///               VAO
+    template<typename I, typename ITarget, typename T, typename Target>
+    void draw_elements(const render_state& s, GLenum mode,
+                       const buffer_slice<I, ITarget>& ebo,
+                       const buffer_slice<T, Target>& vbo,
+                       GLsizei instances = 1)
+    { draw(detail::elements_command(s, mode, ebo, vbo, instances)); }
+
+    /// Drop the recorded commands. The memory is kept.
+    void clear() noexcept
+    {
+        _order.clear();
+        _writes.clear();
+        _draws.clear();
+        _arena.clear();
+    }
+
+    /// Number of recorded commands
+    std::size_t size() const noexcept { return _order.size(); }
+
+    bool empty() const noexcept { return _order.empty(); }
+
+    /// Number of bytes of the arena
+    std::size_t capacity() const noexcept { return _arena.capacity(); }
+private:
+    friend class command_queue;
+
+    enum class kind : std::uint8_t { update, uniform, draw };
+
+    struct entry
+    {
+        kind type;
+        std::size_t index;
+    };
+
+    // Buffer update or uniform block
+    struct data
+    {
+        /// Name of the buffer, or binding point of the block
+        GLuint target;
+        std::size_t offset;
+        std::size_t size;
+        const unsigned char* bytes;
+    };
+
+    std::vector<entry> _order;
+    std::vector<data> _writes;
+    std::vector<render_command> _draws;
+    detail::linear_arena _arena;
+
+    void write(kind type, GLuint target, std::size_t offset,
+               const void* src, std::size_t size, std::size_t alignment)
+    {
+        auto p = _arena.allocate(size, alignment);
+        std::memcpy(p, src, size);
+        _order.push_back(entry{type, _writes.size()});
+        _writes.push_back(data{target, offset, size, p});
+    }
+};
+
+/// Submission of command_lists on the thread of the context
+///
+/// submit() replays the lists in order, each one in the order of
+/// recording. The buffer updates are written with glBufferSubData
+/// from the arenas of the lists, the uniform blocks are copied to a
+/// persistent mapped ring(see uniform_ring) and bound with
+/// glBindBufferRange, and the draws issue only the transitions of
+/// program, VAO and capabilities(see render_queue).
+///
+/// Example:
+///
+///   freijo::command_queue queue;
+///   ...
+///   queue.submit(lists.begin(), lists.end());
+///
+class command_queue
+{
+public:
+    using statistics = render_statistics;
+
+    /// /param uniform_bytes Number of bytes of uniform blocks of each
+    ///                      frame, rounded up to
+    ///                      GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT so every
+    ///                      region starts aligned. A frame with more
+    ///                      blocks waits for the GPU to reuse the next
+    ///                      region.
+    /// /param regions Number of frames in the ring.
+    explicit command_queue(std::size_t uniform_bytes = 1 << 20,
+                           std::size_t regions = 3)
+        : _alignment(detail::uniform_offset_alignment())
+        , _uniforms(detail::align_up(uniform_bytes, _alignment), regions)
+    {}
+
+    command_queue(const command_queue&) = delete;
+    command_queue& operator=(const command_queue&) = delete;
+
+    /// Replay the lists [first, last). The lists aren't cleared.
+    ///
+    /// precondition: no list is being recorded
+    template<typename InputIt>
+    void submit(InputIt first, InputIt last)
+    {
+        _player.begin();
+        _region = _uniforms.next();
+        _used = 0;
+        for(; first != last; ++first)
+            replay(*first);
+        _uniforms.commit();
+    }
+
+    void submit(const command_list& list)
+    { submit(&list, &list + 1); }
+
+    /// Forget the capabilities enabled by the queue, they are queried
+    /// on the next submit().
+    void invalidate() noexcept
+    { _player.invalidate(); }
+
+    const statistics& stats() const noexcept
+    { return _player.stats(); }
+
+    void reset_stats() noexcept
+    { _player.reset_stats(); }
+
+    /// Number of times that the ring of uniform blocks waited for the
+    /// GPU
+    std::size_t stalls() const noexcept { return _uniforms.stalls(); }
+private:
+    using uniform_stream = stream_buffer<GLubyte, detail::uniform_block_target>;
+
+    std::size_t _alignment;
+    uniform_stream _uniforms;
+    uniform_stream::region _region{};
+    std::size_t _used{0};
+    detail::render_player _player;
+
+    void replay(const command_list& list)
+    {
+        for(auto& e : list._order)
+        {
+            switch(e.type)
+            {
+            case command_list::kind::update:
+                update(list._writes[e.index]);
+                break;
+            case command_list::kind::uniform:
+                uniform(list._writes[e.index]);
+                break;
+            case command_list::kind::draw:
+                _player.play(list._draws[e.index]);
+                break;
+            }
+        }
+    }
+
+    static void update(const command_list::data& d)
+    {
+#ifdef FREIJO_DSA
+        glNamedBufferSubData(d.target, d.offset, d.size, d.bytes);
+#else
+        scoped_target_buffer_bind bbg(GL_COPY_WRITE_BUFFER, d.target);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, d.offset, d.size, d.bytes);
+#endif
+    }
+
+    void uniform(const command_list::data& d)
+    {
+        assert(d.size <= _region.size);
+        if(_used + d.size > _region.size)
+        {
+            _uniforms.commit();
+            _region = _uniforms.next();
+            _used = 0;
+        }
+        std::memcpy(_region.data + _used, d.bytes, d.size);
+        state().bind_buffer_range(GL_UNIFORM_BUFFER, d.target,
+                                  _uniforms.id(), _region.offset() + _used,
+                                  d.size);
+        _used = detail::align_up(_used + d.size, _alignment);
+    }
+};
+
+}
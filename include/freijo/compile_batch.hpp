@@ -0,0 +1,114 @@
+
+// Copyright Ricardo Calheiros de Miranda Cosme 2017.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "freijo/extension.hpp"
+#include "freijo/program.hpp"
+#include "freijo/shader.hpp"
+
+#include <cassert>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace freijo {
+
+/// Batch of programs compiled and linked without waiting for each other
+///
+/// add() only submits the compilations and the link, the status is
+/// checked by get(). With GL_KHR_parallel_shader_compile the driver
+/// works on background threads and ready() polls
+/// GL_COMPLETION_STATUS_KHR, so the application can do other work,
+/// e.g. load the meshes, while the programs are built. Without the
+/// extension the work is still submitted before any status query,
+/// which lets drivers with internal threads overlap it.
+///
+/// Example:
+///
+///   freijo::compile_batch batch;
+///   std::vector<std::size_t> handles;
+///   for(auto& m : materials)
+///       handles.push_back(batch.add(freijo::vertex_source{m.vs},
+///                                   freijo::fragment_source{m.fs}));
+///   ...
+///   for(std::size_t i{0}; i < materials.size(); ++i)
+///       materials[i].prog = batch.get(handles[i]);
+///
+class compile_batch
+{
+public:
+    using handle = std::size_t;
+
+    /// /param threads Maximum number of compiler threads
+    ///                (glMaxShaderCompilerThreadsKHR), 0xFFFFFFFF lets
+    ///                the driver choose.
+    explicit compile_batch(GLuint threads = 0xFFFFFFFF)
+    {
+#ifdef GL_KHR_parallel_shader_compile
+        if(has_extension("GL_KHR_parallel_shader_compile"))
+            glMaxShaderCompilerThreadsKHR(threads);
+#else
+        (void)threads;
+#endif
+    }
+
+    /// Submit the compilation of the `sources` and the link of a
+    /// program with them.
+    template<typename... Types>
+    handle add(const shader_source<Types>&... sources)
+    {
+        program::Shaders shaders{
+            detail::compile_shader(Types::glType, sources.code)...};
+        _programs.emplace_back(shaders, deferred);
+        // The shaders are deleted with the program
+        for(auto shader : shaders)
+            glDeleteShader(shader);
+        _taken.push_back(false);
+        return _programs.size() - 1;
+    }
+
+    /// Return true if the program `h` is linked or failed, it never
+    /// blocks.
+    bool ready(handle h) const
+    {
+        assert(h < _programs.size() && !_taken[h]);
+        return _programs[h].ready();
+    }
+
+    /// Number of programs that aren't ready and weren't taken
+    std::size_t pending() const
+    {
+        std::size_t n{0};
+        for(std::size_t h{0}; h < _programs.size(); ++h)
+            if(!_taken[h] && !_programs[h].ready()) ++n;
+        return n;
+    }
+
+    /// Take the program `h`, waiting for its link if it isn't ready.
+    ///
+    /// precondition: `h` wasn't taken
+    ///
+    /// /throw std::runtime_error if a compilation or link error occurs
+    ///
+    program get(handle h)
+    {
+        assert(h < _programs.size() && !_taken[h]);
+        _taken[h] = true;
+        auto res = std::move(_programs[h]);
+        res.check();
+        return res;
+    }
+
+    /// Number of programs added
+    std::size_t size() const noexcept
+    { return _programs.size(); }
+private:
+    std::vector<program> _programs;
+    std::vector<bool> _taken;
+};
+
+}
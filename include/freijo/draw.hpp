@@ -0,0 +1,120 @@
+
+// Copyright Ricardo Calheiros de Miranda Cosme 2017.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "freijo/VAO.hpp"
+#include "freijo/buffer_arena.hpp"
+
+namespace freijo {
+
+// Typed draw calls
+//
+// The number of vertices, the number of indices and the type of the
+// indices come from the buffers. The VAO is left bound after the
+// call, so a sequence of draws with the same VAO binds it only once.
+//
+// Example:
+//
+//   freijo::VBO<glm::mat4> transforms(models);
+//   vao.attach_instanced(1, transforms); //locations 1, 2, 3 and 4
+//   freijo::draw_elements_instanced(GL_TRIANGLES, vao, idxs,
+//                                   transforms.size());
+
+// glDrawArrays with all the vertices of `vbo`
+template<typename VBO>
+void draw_arrays(GLenum mode, const VAO& vao, const VBO& vbo)
+{
+    vao.bind();
+    glDrawArrays(mode, 0, vbo.size());
+}
+
+// glDrawArraysInstanced with all the vertices of `vbo`
+template<typename VBO>
+void draw_arrays_instanced(GLenum mode, const VAO& vao, const VBO& vbo,
+                           GLsizei instances)
+{
+    vao.bind();
+    glDrawArraysInstanced(mode, 0, vbo.size(), instances);
+}
+
+// glDrawElements with all the indices of `ebo`
+//
+// precondition: `ebo` is attached to `vao`
+template<typename EBO>
+void draw_elements(GLenum mode, const VAO& vao, const EBO& ebo)
+{
+    vao.bind();
+    glDrawElements(mode, ebo.size(), EBO::target::GLtype, nullptr);
+}
+
+// glDrawElementsInstanced with all the indices of `ebo`
+//
+// precondition: `ebo` is attached to `vao`
+template<typename EBO>
+void draw_elements_instanced(GLenum mode, const VAO& vao, const EBO& ebo,
+                             GLsizei instances)
+{
+    vao.bind();
+    glDrawElementsInstanced(mode, ebo.size(), EBO::target::GLtype,
+                            nullptr, instances);
+}
+
+// glDrawArrays with the vertices of a slice
+//
+// precondition: the arena of `vbo` is attached to `vao`
+template<typename T, typename Target>
+void draw_arrays(GLenum mode, const VAO& vao,
+                 const buffer_slice<T, Target>& vbo)
+{
+    vao.bind();
+    glDrawArrays(mode, vbo.first(), vbo.size());
+}
+
+// glDrawArraysInstanced with the vertices of a slice
+//
+// precondition: the arena of `vbo` is attached to `vao`
+template<typename T, typename Target>
+void draw_arrays_instanced(GLenum mode, const VAO& vao,
+                           const buffer_slice<T, Target>& vbo,
+                           GLsizei instances)
+{
+    vao.bind();
+    glDrawArraysInstanced(mode, vbo.first(), vbo.size(), instances);
+}
+
+// glDrawElementsBaseVertex with the indices of `ebo`, relative to the
+// first vertex of `vbo`
+//
+// precondition: the arenas of `ebo` and `vbo` are attached to `vao`
+template<typename I, typename ITarget, typename T, typename Target>
+void draw_elements(GLenum mode, const VAO& vao,
+                   const buffer_slice<I, ITarget>& ebo,
+                   const buffer_slice<T, Target>& vbo)
+{
+    vao.bind();
+    glDrawElementsBaseVertex(mode, ebo.size(), ITarget::GLtype,
+                             reinterpret_cast<void*>(ebo.offset()),
+                             vbo.first());
+}
+
+// glDrawElementsInstancedBaseVertex with the indices of `ebo`,
+// relative to the first vertex of `vbo`
+//
+// precondition: the arenas of `ebo` and `vbo` are attached to `vao`
+template<typename I, typename ITarget, typename T, typename Target>
+void draw_elements_instanced(GLenum mode, const VAO& vao,
+                             const buffer_slice<I, ITarget>& ebo,
+                             const buffer_slice<T, Target>& vbo,
+                             GLsizei instances)
+{
+    vao.bind();
+    glDrawElementsInstancedBaseVertex(mode, ebo.size(), ITarget::GLtype,
+                                      reinterpret_cast<void*>(ebo.offset()),
+                                      instances, vbo.first());
+}
+
+}
@@ -0,0 +1,34 @@
+
+// Copyright Ricardo Calheiros de Miranda Cosme 2017.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <cstring>
+
+// GL_KHR_parallel_shader_compile, missing in older loaders
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+namespace freijo {
+
+/// Return true if the current context supports the extension `name`,
+/// e.g. "GL_KHR_parallel_shader_compile"
+/// (Section 22.2 - GetStringi() at OpenGL 4.5 Core Profile)
+inline bool has_extension(const char* name)
+{
+    GLint count{0};
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for(GLint i{0}; i < count; ++i)
+    {
+        auto ext = reinterpret_cast<const char*>
+            (glGetStringi(GL_EXTENSIONS, i));
+        if(ext && std::strcmp(ext, name) == 0) return true;
+    }
+    return false;
+}
+
+}
@@ -0,0 +1,91 @@
+
+// Copyright Ricardo Calheiros de Miranda Cosme 2017.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <utility>
+
+namespace freijo {
+
+/// Abstraction to Sync Objects
+/// (Section 5.2 Sync Objects and Fences at OpenGL 3.3 Core Profile)
+///
+/// A fence is inserted in the command stream with `set()` and it
+/// becomes signaled when the GPU completes all the commands issued
+/// before it.
+///
+/// Model the concept Movable.
+///
+class fence
+{
+public:
+    fence() = default;
+
+    /// Section 5.2 - DeleteSync()
+    /// "If sync is zero, DeleteSync is silently ignored"
+    ~fence()
+    { glDeleteSync(_sync); }
+
+    fence(fence&& rhs) noexcept
+        : _sync(rhs._sync)
+    { rhs._sync = 0; }
+
+    fence& operator=(fence&& rhs) noexcept
+    {
+        std::swap(_sync, rhs._sync);
+        return *this;
+    }
+
+    /// Insert a new fence(glFenceSync) in the command stream. A
+    /// previous fence is released.
+    void set()
+    {
+        glDeleteSync(_sync);
+        _sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    /// Release the fence. A reseted fence is always signaled.
+    void reset()
+    {
+        glDeleteSync(_sync);
+        _sync = 0;
+    }
+
+    /// Return true if the GPU has completed the commands before the
+    /// fence. It never blocks.
+    bool signaled() const
+    {
+        if(!_sync) return true;
+        auto res = glClientWaitSync(_sync, 0, 0);
+        return res == GL_ALREADY_SIGNALED || res == GL_CONDITION_SATISFIED;
+    }
+
+    /// Block the client until the fence is signaled.
+    ///
+    /// /return false if the fence wasn't signaled after all(timeout
+    ///         or GL_WAIT_FAILED)
+    ///
+    bool wait(GLuint64 timeout = GL_TIMEOUT_IGNORED) const
+    {
+        if(!_sync) return true;
+        auto res = glClientWaitSync(_sync, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                    timeout);
+        return res == GL_ALREADY_SIGNALED || res == GL_CONDITION_SATISFIED;
+    }
+
+    /// Make the server(GPU) wait for the fence before executing the
+    /// next commands. The client isn't blocked.
+    void wait_server() const
+    { if(_sync) glWaitSync(_sync, 0, GL_TIMEOUT_IGNORED); }
+
+    /// Return the sync object
+    GLsync id() const noexcept
+    { return _sync; }
+private:
+    GLsync _sync{0};
+};
+
+}
@@ -0,0 +1,237 @@
+
+// Copyright Ricardo Calheiros de Miranda Cosme 2017.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "freijo/buffer.hpp"
+#include "freijo/state.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <utility>
+
+namespace freijo {
+
+/// Buffer object with a capacity larger than its size, like
+/// std::vector
+///
+/// Appending elements only uploads the new elements. When the
+/// capacity is exhausted the storage grows geometrically and the old
+/// elements are moved to the new buffer by the GPU
+/// (glCopyBufferSubData), so a sequence of push_back() costs O(1)
+/// amortised transfers. erase() also moves the tail on the GPU.
+///
+/// The name of the buffer(id()) changes when the storage is
+/// reallocated, which happens only in reserve(), shrink_to_fit() or
+/// when an insertion exceeds the capacity. A VAO must attach the
+/// vector again after a reallocation.
+///
+/// Example:
+///
+///   freijo::gpu_vector<Particle, freijo::ArrayBuffer<Particle>> particles;
+///   particles.push_back(spawned.begin(), spawned.end());
+///   particles.erase(0, expired);
+///
+/// /tparam ValueType Type of the element stored in the buffer.
+/// /tparam Target Purpose of the buffer (see buffer).
+///
+/// Model the concept Movable.
+///
+template<typename ValueType, typename Target>
+class gpu_vector
+{
+public:
+    using value_type = ValueType;
+    using target = Target;
+
+    /// poscondition: size() == 0 && capacity() == 0 && id() == 0
+    gpu_vector() = default;
+
+    /// Allocate storage to `capacity` elements
+    ///
+    /// poscondition: size() == 0
+    explicit gpu_vector(std::size_t capacity,
+                        GLenum usage = GL_DYNAMIC_DRAW)
+        : _usage(usage)
+    { reserve(capacity); }
+
+    ~gpu_vector()
+    { release(); }
+
+    gpu_vector(const gpu_vector&) = delete;
+    gpu_vector& operator=(const gpu_vector&) = delete;
+
+    gpu_vector(gpu_vector&& rhs) noexcept
+    { swap(*this, rhs); }
+
+    gpu_vector& operator=(gpu_vector&& rhs) noexcept
+    {
+        swap(*this, rhs);
+        return *this;
+    }
+
+    friend void swap(gpu_vector& a, gpu_vector& b) noexcept
+    {
+        std::swap(a._id, b._id);
+        std::swap(a._size, b._size);
+        std::swap(a._capacity, b._capacity);
+        std::swap(a._usage, b._usage);
+    }
+
+    /// Grow the storage to at least `n` elements. It never shrinks.
+    void reserve(std::size_t n)
+    {
+        if(n > _capacity) reallocate(n);
+    }
+
+    /// Append the elements [first, last)
+    ///
+    /// /param first Iterator to the first element
+    ///              (models ContiguousIterator).
+    template<typename ContiguousIt>
+    void push_back(ContiguousIt first, ContiguousIt last)
+    {
+        std::size_t n = std::distance(first, last);
+        if(!n) return;
+        grow(_size + n);
+        upload(_size, &*first, n);
+        _size += n;
+    }
+
+    /// Append one element. Prefer the range overload to append many.
+    void push_back(const value_type& value)
+    { push_back(&value, &value + 1); }
+
+    /// Change the number of elements. The new elements are undefined.
+    void resize(std::size_t n)
+    {
+        grow(n);
+        _size = n;
+    }
+
+    /// Remove the elements [first, last), the next elements are moved
+    /// to `first` by the GPU: one glCopyBufferSubData, or two through
+    /// a scratch buffer if the tail overlaps its destination.
+    ///
+    /// precondition: first <= last <= size()
+    void erase(std::size_t first, std::size_t last)
+    {
+        assert(first <= last && last <= _size);
+        if(first == last) return;
+        detail::copy_within(_id, last * sizeof(value_type),
+                            first * sizeof(value_type),
+                            (_size - last) * sizeof(value_type));
+        _size -= last - first;
+    }
+
+    /// Remove all the elements. The capacity is kept.
+    void clear() noexcept
+    { _size = 0; }
+
+    /// Reallocate the storage to size() elements
+    void shrink_to_fit()
+    {
+        if(_size == _capacity) return;
+        if(_size == 0)
+        {
+            release();
+            _capacity = 0;
+            return;
+        }
+        reallocate(_size);
+    }
+
+    void bind() const
+    { state().bind_buffer(target::target, _id); }
+
+    void unbind() const
+    { state().bind_buffer(target::target, 0); }
+
+    /// Number of elements
+    std::size_t size() const noexcept { return _size; }
+
+    /// Number of elements that fit in the storage
+    std::size_t capacity() const noexcept { return _capacity; }
+
+    bool empty() const noexcept { return _size == 0; }
+
+    /// Return the buffer's name
+    GLuint id() const noexcept { return _id; }
+
+    GLenum usage() const noexcept { return _usage; }
+private:
+    GLuint _id{0};
+    std::size_t _size{0};
+    std::size_t _capacity{0};
+    GLenum _usage{GL_DYNAMIC_DRAW};
+
+    // Geometric growth
+    void grow(std::size_t n)
+    {
+        if(n > _capacity)
+            reallocate(std::max(n, 2 * _capacity));
+    }
+
+    // Move the elements to a new buffer of `capacity` elements
+    void reallocate(std::size_t capacity)
+    {
+        GLuint id{0};
+        auto bytes = capacity * sizeof(value_type);
+        auto used = _size * sizeof(value_type);
+#ifdef FREIJO_DSA
+        glCreateBuffers(1, &id);
+        glNamedBufferData(id, bytes, nullptr, _usage);
+        if(used) glCopyNamedBufferSubData(_id, id, 0, 0, used);
+#else
+        glGenBuffers(1, &id);
+        {
+            scoped_target_buffer_bind bbgw(GL_COPY_WRITE_BUFFER, id);
+            glBufferData(GL_COPY_WRITE_BUFFER, bytes, nullptr, _usage);
+            if(used)
+            {
+                scoped_target_buffer_bind bbgr(GL_COPY_READ_BUFFER, _id);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER,
+                                    GL_COPY_WRITE_BUFFER, 0, 0, used);
+            }
+        }
+#endif
+        release();
+        _id = id;
+        _capacity = capacity;
+    }
+
+    void upload(std::size_t pos, const value_type* data, std::size_t n)
+    {
+#ifdef FREIJO_DSA
+        glNamedBufferSubData(_id, pos * sizeof(value_type),
+                             n * sizeof(value_type), data);
+#else
+        scoped_target_buffer_bind bbg(GL_COPY_WRITE_BUFFER, _id);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, pos * sizeof(value_type),
+                        n * sizeof(value_type), data);
+#endif
+    }
+
+    void release()
+    {
+        if(!_id) return;
+        glDeleteBuffers(1, &_id);
+        state().buffer_deleted(_id);
+        _id = 0;
+    }
+};
+
+/// Alias template to a growable vector of vertex attributes
+template<typename ValueType>
+using VBO_vector = gpu_vector<ValueType, ArrayBuffer<ValueType>>;
+
+/// Alias template to a growable vector of indices
+template<typename ValueType>
+using EBO_vector = gpu_vector<ValueType, ElementArray<ValueType>>;
+
+}
@@ -0,0 +1,45 @@
+
+// Copyright Ricardo Calheiros de Miranda Cosme 2017.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace freijo {
+
+/// 32-bit FNV-1a hash of a null-terminated string
+///
+/// It's constexpr, so the hash of a literal is computed at compile
+/// time and it can be used as a template argument.
+constexpr std::uint32_t fnv1a(const char* s,
+                              std::uint32_t h = 2166136261u)
+{
+    return *s
+        ? fnv1a(s + 1, (h ^ static_cast<std::uint8_t>(*s)) * 16777619u)
+        : h;
+}
+
+/// 64-bit FNV-1a hash of `size` bytes. The hash of a sequence of
+/// buffers is computed by passing the previous hash as `h`.
+inline std::uint64_t fnv1a64(const void* data, std::size_t size,
+                             std::uint64_t h = 14695981039346656037ull)
+{
+    auto p = static_cast<const unsigned char*>(data);
+    for(std::size_t i{0}; i < size; ++i)
+        h = (h ^ p[i]) * 1099511628211ull;
+    return h;
+}
+
+namespace literals {
+
+/// Hash of a name, e.g. prog.set<"mvp"_h>(mvp)
+constexpr std::uint32_t operator"" _h(const char* s, std::size_t)
+{ return fnv1a(s); }
+
+}
+
+}
@@ -0,0 +1,383 @@
+
+// Copyright Ricardo Calheiros de Miranda Cosme 2017.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "freijo/VAO.hpp"
+#include "freijo/state.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace freijo {
+
+namespace detail {
+
+/// Narrowest index type able to address the vertices [0, max]. The
+/// largest value of each type is kept free for the primitive restart
+/// index(GL_PRIMITIVE_RESTART_FIXED_INDEX).
+inline GLenum index_type(GLuint max, bool allow_ubyte = false)
+{
+    if(allow_ubyte && max < 0xFF) return GL_UNSIGNED_BYTE;
+    if(max < 0xFFFF) return GL_UNSIGNED_SHORT;
+    return GL_UNSIGNED_INT;
+}
+
+inline std::size_t index_bytes(GLenum type)
+{
+    switch(type)
+    {
+    case GL_UNSIGNED_BYTE: return 1;
+    case GL_UNSIGNED_SHORT: return 2;
+    }
+    return 4;
+}
+
+}
+
+/// Buffer of indices whose type is chosen at runtime
+///
+/// The indices are given as GLuint and stored with the narrowest type
+/// that fits the largest index: GL_UNSIGNED_SHORT unless an index is
+/// 65535 or more. GL_UNSIGNED_BYTE is only chosen on request, because
+/// several drivers convert it to 16 bits on every draw. The type is
+/// erased, draw_elements() passes type() to OpenGL.
+///
+/// Example:
+///
+///   auto report = freijo::optimize_vertex_cache(indices, vertices.size());
+///   auto remap = freijo::optimize_vertex_fetch(indices, vertices);
+///   freijo::index_buffer ebo(indices);
+///   vao.attach(ebo);
+///   freijo::draw_elements(GL_TRIANGLES, vao, ebo);
+///
+/// Model the concept Movable.
+///
+class index_buffer
+{
+public:
+    /// poscondition: size() == 0 && id() == 0
+    index_buffer() = default;
+
+    /// Allocate a buffer with [first, last) converted to the
+    /// narrowest index type.
+    ///
+    /// /param first Iterator to the first index
+    ///              (models ContiguousIterator of GLuint).
+    template<typename ContiguousIt, typename = typename std::enable_if<
+                 !std::is_integral<ContiguousIt>::value>::type>
+    index_buffer(ContiguousIt first, ContiguousIt last,
+                 GLenum usage = GL_STATIC_DRAW, bool allow_ubyte = false)
+        : _size(std::distance(first, last))
+    {
+        GLuint max{0};
+        for(auto it = first; it != last; ++it) max = std::max(max, *it);
+        _type = detail::index_type(max, allow_ubyte);
+        switch(_type)
+        {
+        case GL_UNSIGNED_BYTE:
+            alloc(std::vector<GLubyte>(first, last).data(), usage);
+            break;
+        case GL_UNSIGNED_SHORT:
+            alloc(std::vector<GLushort>(first, last).data(), usage);
+            break;
+        default:
+            alloc(&*first, usage);
+        }
+    }
+
+    explicit index_buffer(const std::vector<GLuint>& indices,
+                          GLenum usage = GL_STATIC_DRAW,
+                          bool allow_ubyte = false)
+        : index_buffer(indices.data(), indices.data() + indices.size(),
+                       usage, allow_ubyte)
+    {}
+
+    /// Allocate a buffer of `count` indices of `type`
+    ///
+    /// poscondition: the content of the buffer is undefined.
+    index_buffer(std::size_t count, GLenum type,
+                 GLenum usage = GL_STATIC_DRAW)
+        : _size(count)
+        , _type(type)
+    { alloc(nullptr, usage); }
+
+    ~index_buffer()
+    {
+        if(!_id) return;
+        glDeleteBuffers(1, &_id);
+        state().buffer_deleted(_id);
+    }
+
+    index_buffer(const index_buffer&) = delete;
+    index_buffer& operator=(const index_buffer&) = delete;
+
+    index_buffer(index_buffer&& rhs) noexcept
+    { swap(*this, rhs); }
+
+    index_buffer& operator=(index_buffer&& rhs) noexcept
+    {
+        swap(*this, rhs);
+        return *this;
+    }
+
+    friend void swap(index_buffer& a, index_buffer& b) noexcept
+    {
+        std::swap(a._id, b._id);
+        std::swap(a._size, b._size);
+        std::swap(a._type, b._type);
+    }
+
+    void bind() const
+    { state().bind_buffer(GL_ELEMENT_ARRAY_BUFFER, _id); }
+
+    void unbind() const
+    { state().bind_buffer(GL_ELEMENT_ARRAY_BUFFER, 0); }
+
+    /// Number of indices
+    std::size_t size() const noexcept { return _size; }
+
+    bool empty() const noexcept { return _size == 0; }
+
+    /// GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    GLenum type() const noexcept { return _type; }
+
+    /// Number of bytes of an index
+    std::size_t index_size() const noexcept
+    { return detail::index_bytes(_type); }
+
+    /// Return the buffer's name
+    GLuint id() const noexcept { return _id; }
+private:
+    GLuint _id{0};
+    std::size_t _size{0};
+    GLenum _type{GL_UNSIGNED_SHORT};
+
+    // COPY_WRITE_BUFFER isn't part of the state of the bound VAO
+    void alloc(const void* data, GLenum usage)
+    {
+        auto bytes = _size * index_size();
+#ifdef FREIJO_DSA
+        glCreateBuffers(1, &_id);
+        glNamedBufferData(_id, bytes, data, usage);
+#else
+        glGenBuffers(1, &_id);
+        scoped_target_buffer_bind bbg(GL_COPY_WRITE_BUFFER, _id);
+        glBufferData(GL_COPY_WRITE_BUFFER, bytes, data, usage);
+#endif
+    }
+};
+
+/// glDrawElements with all the indices of `ebo`
+///
+/// precondition: `ebo` is attached to `vao`
+inline void draw_elements(GLenum mode, const VAO& vao,
+                          const index_buffer& ebo)
+{
+    vao.bind();
+    glDrawElements(mode, ebo.size(), ebo.type(), nullptr);
+}
+
+/// glDrawElementsInstanced with all the indices of `ebo`
+///
+/// precondition: `ebo` is attached to `vao`
+inline void draw_elements_instanced(GLenum mode, const VAO& vao,
+                                    const index_buffer& ebo,
+                                    GLsizei instances)
+{
+    vao.bind();
+    glDrawElementsInstanced(mode, ebo.size(), ebo.type(), nullptr,
+                            instances);
+}
+
+/// Average cache miss ratio: number of vertices transformed per
+/// triangle by a FIFO post-transform cache of `cache_size` vertices.
+/// It goes from 3(no reuse) down to about 0.5 for regular grids.
+///
+/// precondition: indices.size() % 3 == 0(GL_TRIANGLES)
+inline double acmr(const std::vector<GLuint>& indices,
+                   std::size_t cache_size = 32)
+{
+    if(indices.empty()) return 0.0;
+    std::vector<GLuint> fifo(cache_size, std::numeric_limits<GLuint>::max());
+    std::size_t head{0}, misses{0};
+    for(auto i : indices)
+    {
+        if(std::find(fifo.begin(), fifo.end(), i) != fifo.end()) continue;
+        fifo[head] = i;
+        head = (head + 1) % cache_size;
+        ++misses;
+    }
+    return static_cast<double>(misses) / (indices.size() / 3);
+}
+
+/// ACMR of the indices before and after optimize_vertex_cache
+struct vertex_cache_report
+{
+    double acmr_before;
+    double acmr_after;
+};
+
+namespace detail {
+
+// Tom Forsyth, "Linear-Speed Vertex Cache Optimisation", 2006
+constexpr std::size_t forsyth_cache_size{32};
+
+// Score of a vertex at `position` of the LRU cache(-1 if it isn't
+// cached) used by `valence` triangles not emitted yet
+inline float forsyth_score(int position, std::size_t valence)
+{
+    if(valence == 0) return -1.0f;
+    float s{0.0f};
+    if(position >= 0)
+        s = position < 3 ? 0.75f
+            : std::pow(1.0f - static_cast<float>(position - 3)
+                       / (forsyth_cache_size - 3), 1.5f);
+    return s + 2.0f / std::sqrt(static_cast<float>(valence));
+}
+
+}
+
+/// Reorder the triangles to reuse the post-transform vertex cache with
+/// the algorithm of Forsyth. The vertices are left unchanged.
+///
+/// precondition: indices.size() % 3 == 0(GL_TRIANGLES) && all the
+///               indices are less than `vertex_count`
+inline vertex_cache_report
+optimize_vertex_cache(std::vector<GLuint>& indices, std::size_t vertex_count)
+{
+    assert(indices.size() % 3 == 0);
+    using detail::forsyth_cache_size;
+    using detail::forsyth_score;
+    vertex_cache_report report{acmr(indices), 0.0};
+    const std::size_t ntriangles{indices.size() / 3};
+
+    // Triangles of each vertex not emitted yet(adjacency[first[v],
+    // first[v] + valence[v]))
+    std::vector<std::size_t> valence(vertex_count, 0), first(vertex_count + 1);
+    for(auto i : indices) ++valence[i];
+    for(std::size_t v{0}; v < vertex_count; ++v)
+        first[v + 1] = first[v] + valence[v];
+    std::vector<std::size_t> adjacency(indices.size()), fill(first);
+    for(std::size_t t{0}; t < ntriangles; ++t)
+        for(std::size_t k{0}; k < 3; ++k)
+            adjacency[fill[indices[3 * t + k]]++] = t;
+
+    std::vector<float> vscore(vertex_count), tscore(ntriangles, 0.0f);
+    for(std::size_t v{0}; v < vertex_count; ++v)
+        vscore[v] = forsyth_score(-1, valence[v]);
+    for(std::size_t t{0}; t < ntriangles; ++t)
+        for(std::size_t k{0}; k < 3; ++k)
+            tscore[t] += vscore[indices[3 * t + k]];
+
+    std::vector<bool> emitted(ntriangles, false);
+    std::vector<GLuint> cache, next, output;
+    cache.reserve(forsyth_cache_size + 3);
+    next.reserve(forsyth_cache_size + 3);
+    output.reserve(indices.size());
+    std::size_t cursor{0};
+    auto best = ntriangles;
+    for(std::size_t n{0}; n < ntriangles; ++n)
+    {
+        if(best == ntriangles)
+        {
+            while(emitted[cursor]) ++cursor;
+            best = cursor;
+        }
+        emitted[best] = true;
+        const GLuint* tri = &indices[3 * best];
+        next.assign(tri, tri + 3);
+        for(std::size_t k{0}; k < 3; ++k)
+        {
+            auto v = tri[k];
+            output.push_back(v);
+            auto adj = adjacency.begin() + first[v];
+            auto last = adj + valence[v];
+            std::iter_swap(std::find(adj, last, best), last - 1);
+            --valence[v];
+        }
+        for(auto v : cache)
+            if(std::find(next.begin(), next.begin() + 3, v)
+               == next.begin() + 3)
+                next.push_back(v);
+        // Rescore the vertices and their triangles: the cached ones
+        // and those pushed out of the cache.
+        auto rescore = [&](GLuint v, int position)
+        {
+            auto delta = forsyth_score(position, valence[v]) - vscore[v];
+            vscore[v] += delta;
+            for(auto t = first[v]; t < first[v] + valence[v]; ++t)
+                tscore[adjacency[t]] += delta;
+        };
+        for(std::size_t p{0}; p < next.size(); ++p)
+            rescore(next[p], p < forsyth_cache_size
+                             ? static_cast<int>(p) : -1);
+        next.resize(std::min(next.size(), forsyth_cache_size));
+        std::swap(cache, next);
+
+        // The best triangle of the cached vertices is the next one
+        best = ntriangles;
+        float score{-1.0f};
+        for(auto v : cache)
+            for(auto t = first[v]; t < first[v] + valence[v]; ++t)
+                if(tscore[adjacency[t]] > score)
+                {
+                    score = tscore[adjacency[t]];
+                    best = adjacency[t];
+                }
+    }
+    indices.swap(output);
+    report.acmr_after = acmr(indices);
+    return report;
+}
+
+/// Move each vertex `v` to the position remap[v]
+///
+/// precondition: remap is a permutation of [0, vertices.size())
+template<typename T>
+void remap_vertices(std::vector<T>& vertices,
+                    const std::vector<GLuint>& remap)
+{
+    assert(remap.size() == vertices.size());
+    std::vector<T> out(vertices.size());
+    for(std::size_t v{0}; v < vertices.size(); ++v)
+        out[remap[v]] = std::move(vertices[v]);
+    vertices.swap(out);
+}
+
+/// Reorder `vertices` in the order of their first use by `indices`,
+/// so the vertex fetch reads the memory sequentially, and rewrite the
+/// indices. The vertices not referenced go to the end.
+///
+/// /return Remap table, the new position of each old vertex. Apply it
+///         to the other attribute streams with remap_vertices.
+template<typename T>
+std::vector<GLuint> optimize_vertex_fetch(std::vector<GLuint>& indices,
+                                          std::vector<T>& vertices)
+{
+    const auto unused = std::numeric_limits<GLuint>::max();
+    std::vector<GLuint> remap(vertices.size(), unused);
+    GLuint next{0};
+    for(auto& i : indices)
+    {
+        if(remap[i] == unused) remap[i] = next++;
+        i = remap[i];
+    }
+    for(auto& r : remap)
+        if(r == unused) r = next++;
+    remap_vertices(vertices, remap);
+    return remap;
+}
+
+}
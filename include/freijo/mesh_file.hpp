@@ -0,0 +1,357 @@
+
+// Copyright Ricardo Calheiros de Miranda Cosme 2017.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "freijo/buffer.hpp"
+#include "freijo/index_buffer.hpp"
+#include "freijo/state.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace freijo {
+
+/// Read-only memory mapping of a file(POSIX mmap)
+///
+/// The pages are read from the file on demand and release() gives
+/// them back, so a file larger than the memory can be traversed
+/// sequentially.
+///
+/// Model the concept Movable.
+///
+class mapped_file
+{
+public:
+    /// /throw std::runtime_error if the file can't be opened or mapped
+    explicit mapped_file(const std::string& path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0)
+            throw std::runtime_error("Failed to open " + path);
+        struct stat st;
+        if(::fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            _size = static_cast<std::size_t>(st.st_size);
+            auto p = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+            _data = p == MAP_FAILED ? nullptr
+                : static_cast<const unsigned char*>(p);
+        }
+        ::close(fd);
+        if(!_data)
+            throw std::runtime_error("Failed to map " + path);
+        ::madvise(const_cast<unsigned char*>(_data), _size, MADV_SEQUENTIAL);
+    }
+
+    ~mapped_file()
+    { if(_data) ::munmap(const_cast<unsigned char*>(_data), _size); }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    mapped_file(mapped_file&& rhs) noexcept
+    {
+        std::swap(_data, rhs._data);
+        std::swap(_size, rhs._size);
+    }
+
+    mapped_file& operator=(mapped_file&& rhs) noexcept
+    {
+        std::swap(_data, rhs._data);
+        std::swap(_size, rhs._size);
+        return *this;
+    }
+
+    /// Drop the resident pages inside [offset, offset + size). They
+    /// are read again from the file if accessed.
+    void release(std::size_t offset, std::size_t size) const
+    {
+        const std::size_t page = ::sysconf(_SC_PAGESIZE);
+        auto first = (offset + page - 1) / page * page;
+        auto last = (offset + size) / page * page;
+        if(first < last)
+            ::madvise(const_cast<unsigned char*>(_data) + first,
+                      last - first, MADV_DONTNEED);
+    }
+
+    const unsigned char* data() const noexcept { return _data; }
+    std::size_t size() const noexcept { return _size; }
+private:
+    const unsigned char* _data{nullptr};
+    std::size_t _size{0};
+};
+
+/// Header of the binary mesh format
+///
+/// The header is followed by the vertices and then by the indices,
+/// each one starting at an offset multiple of 16. The vertices are
+/// stored as they are in memory, so the file is only readable by a
+/// machine with the same endianness.
+struct mesh_header
+{
+    char magic[4];
+    std::uint32_t version;
+
+    /// Number of bytes of a vertex
+    std::uint32_t stride;
+
+    /// GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    std::uint32_t index_type;
+
+    std::uint64_t vertex_count;
+    std::uint64_t index_count;
+
+    /// Offsets in bytes from the beginning of the file
+    std::uint64_t vertex_offset;
+    std::uint64_t index_offset;
+};
+
+namespace detail {
+
+constexpr char mesh_magic[4] = {'F', 'R', 'J', 'M'};
+constexpr std::uint32_t mesh_version{1};
+
+inline std::uint64_t align16(std::uint64_t n)
+{ return (n + 15) / 16 * 16; }
+
+// Return true if `count` elements of `bytes` each starting at `offset`
+// fit in a file of `size` bytes, without overflowing on a corrupt
+// header.
+inline bool fits(std::uint64_t offset, std::uint64_t count,
+                 std::uint64_t bytes, std::uint64_t size)
+{ return offset <= size && count <= (size - offset) / bytes; }
+
+inline bool valid_index_type(std::uint32_t type)
+{
+    return type == GL_UNSIGNED_BYTE || type == GL_UNSIGNED_SHORT
+        || type == GL_UNSIGNED_INT;
+}
+
+// Copy `bytes` of `file` starting at `offset` to the beginning of the
+// buffer `id`, one mapped range of at most `chunk` bytes at a time.
+// The pages of the file are released after each chunk.
+inline void stream_to_buffer(GLuint id, const mapped_file& file,
+                             std::size_t offset, std::size_t bytes,
+                             std::size_t chunk)
+{
+    // The buffer was just allocated, nothing reads it yet.
+    const GLbitfield access{GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT
+                            | GL_MAP_UNSYNCHRONIZED_BIT};
+#ifndef FREIJO_DSA
+    scoped_target_buffer_bind bbg(GL_COPY_WRITE_BUFFER, id);
+#endif
+    for(std::size_t done{0}; done < bytes;)
+    {
+        auto n = std::min(chunk, bytes - done);
+#ifdef FREIJO_DSA
+        auto p = glMapNamedBufferRange(id, done, n, access);
+#else
+        auto p = glMapBufferRange(GL_COPY_WRITE_BUFFER, done, n, access);
+#endif
+        if(!p) throw std::runtime_error("Failed to map the buffer");
+        std::memcpy(p, file.data() + offset + done, n);
+#ifdef FREIJO_DSA
+        glUnmapNamedBuffer(id);
+#else
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+#endif
+        file.release(offset + done, n);
+        done += n;
+    }
+}
+
+}
+
+/// Write the binary mesh format(see mesh_file). The indices are
+/// stored with the narrowest type(see index_buffer).
+///
+/// /throw std::runtime_error if the file can't be written
+template<typename Vertex>
+void write_mesh(const std::string& path, view<Vertex> vertices,
+                view<GLuint> indices)
+{
+    GLuint max{0};
+    for(auto i : indices) max = std::max(max, i);
+    mesh_header h{};
+    std::memcpy(h.magic, detail::mesh_magic, sizeof(h.magic));
+    h.version = detail::mesh_version;
+    h.stride = sizeof(Vertex);
+    h.index_type = detail::index_type(max);
+    h.vertex_count = vertices.size;
+    h.index_count = indices.size;
+    h.vertex_offset = detail::align16(sizeof(h));
+    h.index_offset = detail::align16(h.vertex_offset
+                                     + vertices.size * sizeof(Vertex));
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    const char zeros[16] = {};
+    auto pad = [&](std::uint64_t offset)
+    { out.write(zeros, offset - static_cast<std::uint64_t>(out.tellp())); };
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    pad(h.vertex_offset);
+    out.write(reinterpret_cast<const char*>(vertices.data),
+              vertices.size * sizeof(Vertex));
+    pad(h.index_offset);
+    // Narrowed one block at a time
+    std::vector<char> block;
+    const std::size_t n{4096};
+    auto bytes = detail::index_bytes(h.index_type);
+    for(std::size_t first{0}; first < indices.size; first += n)
+    {
+        auto count = std::min(n, indices.size - first);
+        block.resize(count * bytes);
+        for(std::size_t i{0}; i < count; ++i)
+        {
+            auto index = indices.data[first + i];
+            if(bytes == 1)
+                block[i] = static_cast<char>(index);
+            else if(bytes == 2)
+            {
+                auto s = static_cast<GLushort>(index);
+                std::memcpy(&block[2 * i], &s, 2);
+            }
+            else
+                std::memcpy(&block[4 * i], &index, 4);
+        }
+        out.write(block.data(), block.size());
+    }
+    if(!out)
+        throw std::runtime_error("Failed to write " + path);
+}
+
+template<typename Vertex>
+void write_mesh(const std::string& path, const std::vector<Vertex>& vertices,
+                const std::vector<GLuint>& indices)
+{
+    write_mesh(path, make_view(vertices.data(), vertices.size()),
+               make_view(indices.data(), indices.size()));
+}
+
+/// Mesh stored in a memory-mapped file
+///
+/// Nothing is read at construction besides the header. The vertices
+/// and indices are streamed to the GPU in chunks by load_vertices and
+/// load_indices, and the pages of the file are released after each
+/// chunk, so a mesh of several GB is loaded without being resident in
+/// memory nor copied to the heap.
+///
+/// Example:
+///
+///   freijo::write_mesh("terrain.mesh", vertices, indices); //offline
+///   ...
+///   freijo::mesh_file mesh("terrain.mesh");
+///   auto vbo = freijo::load_vertices<Vertex>(mesh);
+///   auto ebo = freijo::load_indices(mesh);
+///   vao.attach(0, vbo);
+///   vao.attach(ebo);
+///   freijo::draw_elements(GL_TRIANGLES, vao, ebo);
+///
+/// The vertices can also be read in place with vertices<Vertex>().
+///
+class mesh_file
+{
+public:
+    /// /throw std::runtime_error if the file can't be mapped or isn't
+    ///        a valid mesh.
+    explicit mesh_file(const std::string& path)
+        : _file(path)
+    {
+        if(_file.size() < sizeof(_header))
+            throw std::runtime_error("Invalid mesh file " + path);
+        std::memcpy(&_header, _file.data(), sizeof(_header));
+        if(std::memcmp(_header.magic, detail::mesh_magic, 4) != 0
+           || _header.version != detail::mesh_version
+           || _header.stride == 0
+           || !detail::valid_index_type(_header.index_type)
+           || !detail::fits(_header.vertex_offset, _header.vertex_count,
+                            _header.stride, _file.size())
+           || !detail::fits(_header.index_offset, _header.index_count,
+                            detail::index_bytes(_header.index_type),
+                            _file.size()))
+            throw std::runtime_error("Invalid mesh file " + path);
+    }
+
+    std::size_t vertex_count() const noexcept
+    { return _header.vertex_count; }
+
+    std::size_t index_count() const noexcept
+    { return _header.index_count; }
+
+    /// Number of bytes of a vertex
+    std::size_t stride() const noexcept
+    { return _header.stride; }
+
+    GLenum index_type() const noexcept
+    { return _header.index_type; }
+
+    /// Vertices read in place from the mapped file
+    ///
+    /// /throw std::runtime_error if sizeof(Vertex) != stride()
+    template<typename Vertex>
+    view<Vertex> vertices() const
+    {
+        check_stride(sizeof(Vertex));
+        return make_view(reinterpret_cast<const Vertex*>(
+            _file.data() + _header.vertex_offset), vertex_count());
+    }
+
+    const mesh_header& header() const noexcept { return _header; }
+    const mapped_file& file() const noexcept { return _file; }
+
+    void check_stride(std::size_t stride) const
+    {
+        if(stride != _header.stride)
+            throw std::runtime_error("The vertex type doesn't match the "
+                                     "stride of the mesh file");
+    }
+private:
+    mapped_file _file;
+    mesh_header _header;
+};
+
+/// Stream the vertices of `mesh` to a new buffer in chunks of `chunk`
+/// bytes.
+///
+/// /throw std::runtime_error if sizeof(Vertex) != mesh.stride()
+template<typename Vertex, typename Target = ArrayBuffer<Vertex>>
+buffer<Vertex, Target> load_vertices(const mesh_file& mesh,
+                                     std::size_t chunk = 1 << 22,
+                                     GLenum usage = GL_STATIC_DRAW)
+{
+    mesh.check_stride(sizeof(Vertex));
+    buffer<Vertex, Target> vbo(mesh.vertex_count(), usage);
+    detail::stream_to_buffer(vbo.id(), mesh.file(),
+                             mesh.header().vertex_offset,
+                             mesh.vertex_count() * sizeof(Vertex), chunk);
+    return vbo;
+}
+
+/// Stream the indices of `mesh` to a new index_buffer in chunks of
+/// `chunk` bytes.
+inline index_buffer load_indices(const mesh_file& mesh,
+                                 std::size_t chunk = 1 << 22,
+                                 GLenum usage = GL_STATIC_DRAW)
+{
+    index_buffer ebo(mesh.index_count(), mesh.index_type(), usage);
+    detail::stream_to_buffer(ebo.id(), mesh.file(),
+                             mesh.header().index_offset,
+                             mesh.index_count() * ebo.index_size(), chunk);
+    return ebo;
+}
+
+}
@@ -0,0 +1,370 @@
+
+// Copyright Ricardo Calheiros de Miranda Cosme 2017.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "freijo/buffer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <vector>
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__) || defined(__F16C__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace freijo {
+
+/// Compact vertex component types
+///
+/// A normal stored as glm::vec3 takes 12 bytes and a color stored as
+/// glm::vec4 takes 16, while 4 bytes are enough for both:
+///
+///   half2, half4        -> GL_HALF_FLOAT (positions, texcoords)
+///   snorm_2_10_10_10    -> GL_INT_2_10_10_10_REV (normals, tangents)
+///   normalized<Vec>     -> GL_BYTE, GL_SHORT, GL_UNSIGNED_BYTE, ...
+///                          mapped to [-1, 1] or [0, 1] (normals,
+///                          colors)
+///
+/// The packed and normalized types are always attached with
+/// normalized = GL_TRUE by VAO::attach and FREIJO_ATTRIB.
+///
+/// pack() converts arrays of glm vectors at upload time:
+///
+///   freijo::VBO<freijo::snorm_2_10_10_10> normals(
+///       freijo::pack<freijo::snorm_2_10_10_10>(mesh.normals));
+///   vao.attach(1, normals);
+///
+/// The kernels use F16C to convert to half, AVX2 to pack
+/// 2_10_10_10 and SSE2 to normalize to integers when the compiler
+/// targets them(e.g. -mavx2 -mf16c or -march=native), with a scalar
+/// fallback that produces the same values.
+
+/// IEEE 754 binary16 floating point number
+struct half
+{
+    std::uint16_t bits;
+};
+
+struct half2
+{
+    half x, y;
+};
+
+struct half4
+{
+    half x, y, z, w;
+};
+
+/// Four signed normalized components packed in 32 bits: x in the bits
+/// 0-9, y in 10-19, z in 20-29 and w in 30-31
+/// (Section 10.3.8 Vertex Attribute Conversions at OpenGL 4.5 Core
+/// Profile)
+struct snorm_2_10_10_10
+{
+    GLuint bits;
+};
+
+/// Vector of integers mapped to [-1, 1](signed) or [0, 1](unsigned)
+/// by the vertex fetch, e.g. normalized<glm::tvec4<GLbyte>>.
+template<typename Vec>
+struct normalized
+{
+    static_assert(std::is_integral<typename Vec::value_type>::value,
+                  "Only integer components can be normalized");
+    Vec value;
+};
+
+template<>
+struct VertexTraits<half2>
+{
+    static const GLenum type{GL_HALF_FLOAT};
+    static const GLint size{2};
+    static const GLint columns{1};
+};
+
+template<>
+struct VertexTraits<half4>
+{
+    static const GLenum type{GL_HALF_FLOAT};
+    static const GLint size{4};
+    static const GLint columns{1};
+};
+
+template<>
+struct VertexTraits<snorm_2_10_10_10>
+{
+    static const GLenum type{GL_INT_2_10_10_10_REV};
+    static const GLint size{4};
+    static const GLint columns{1};
+    static const GLboolean normalized{GL_TRUE};
+};
+
+template<typename Vec>
+struct VertexTraits<freijo::normalized<Vec>> : VertexTraits<Vec>
+{
+    static const GLboolean normalized{GL_TRUE};
+};
+
+/// Convert to half rounding to the nearest even
+inline half to_half(float f)
+{
+    std::uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+    std::uint16_t sign = (x >> 16) & 0x8000;
+    std::uint32_t abs = x & 0x7FFFFFFF;
+    // Inf and NaN
+    if(abs >= 0x7F800000)
+        return {static_cast<std::uint16_t>(
+            sign | 0x7C00
+            | (abs > 0x7F800000 ? 0x200 | ((abs >> 13) & 0x3FF) : 0))};
+    // Rounds to Inf(>= 65520)
+    if(abs >= 0x477FF000)
+        return {static_cast<std::uint16_t>(sign | 0x7C00)};
+    // Subnormal half(< 2^-14): multiple of 2^-24
+    if(abs < 0x38800000)
+    {
+        float a;
+        std::memcpy(&a, &abs, sizeof(a));
+        return {static_cast<std::uint16_t>(
+            sign | std::lrint(a * 16777216.0f))};
+    }
+    // Normal half: rebias the exponent and round the mantissa
+    abs += 0xFFF + ((abs >> 13) & 1);
+    return {static_cast<std::uint16_t>(sign | ((abs - 0x38000000) >> 13))};
+}
+
+inline float to_float(half h)
+{
+    std::uint32_t sign = static_cast<std::uint32_t>(h.bits & 0x8000) << 16;
+    std::uint32_t exponent = (h.bits >> 10) & 0x1F;
+    std::uint32_t mantissa = h.bits & 0x3FF;
+    float f;
+    if(exponent == 0)
+    {
+        f = std::ldexp(static_cast<float>(mantissa), -24);
+        return sign ? -f : f;
+    }
+    std::uint32_t x = sign | (mantissa << 13) | (exponent == 0x1F
+        ? 0x7F800000 : (exponent + 112) << 23);
+    std::memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+namespace detail {
+
+inline float clamp(float f, float lo, float hi)
+{ return std::min(std::max(f, lo), hi); }
+
+// round(clamp(f, -1, 1) * max) or round(clamp(f, 0, 1) * max)
+template<typename T>
+inline T to_norm(float f)
+{
+    const float lo = std::is_signed<T>::value ? -1.0f : 0.0f;
+    return static_cast<T>(std::lrint(clamp(f, lo, 1.0f)
+                                     * std::numeric_limits<T>::max()));
+}
+
+inline GLuint to_2_10_10_10(float x, float y, float z, float w)
+{
+    auto c = [](float f, float max)
+    { return static_cast<GLuint>(std::lrint(clamp(f, -1.0f, 1.0f) * max)); };
+    return (c(x, 511.0f) & 0x3FF) | (c(y, 511.0f) & 0x3FF) << 10
+        | (c(z, 511.0f) & 0x3FF) << 20 | (c(w, 1.0f) & 0x3) << 30;
+}
+
+#if defined(__SSE2__)
+// (v.x, v.y, v.z, w). Reads 16 bytes, so `v` can't be the last
+// element of the array.
+inline __m128 load_xyz(const glm::vec3& v, __m128 w)
+{
+    const __m128 xyz = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+    return _mm_or_ps(_mm_and_ps(_mm_loadu_ps(&v.x), xyz), w);
+}
+
+inline __m128i to_norm(__m128 v, float lo, float max)
+{
+    v = _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(lo)), _mm_set1_ps(1.0f));
+    return _mm_cvtps_epi32(_mm_mul_ps(v, _mm_set1_ps(max)));
+}
+#endif
+
+inline void pack_half(const glm::vec3* in, half4* out, std::size_t n,
+                      float w)
+{
+    std::size_t i{0};
+#if defined(__F16C__)
+    const __m128 wl = _mm_set_ps(w, 0.0f, 0.0f, 0.0f);
+    for(; i + 1 < n; ++i)
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i),
+                         _mm_cvtps_ph(load_xyz(in[i], wl),
+                                      _MM_FROUND_TO_NEAREST_INT));
+#endif
+    for(; i < n; ++i)
+        out[i] = {to_half(in[i].x), to_half(in[i].y), to_half(in[i].z),
+                  to_half(w)};
+}
+
+inline void pack_half(const glm::vec2* in, half2* out, std::size_t n)
+{
+    std::size_t i{0};
+#if defined(__F16C__)
+    // Two vertices per iteration
+    for(; i + 2 <= n; i += 2)
+    {
+        __m128 v = _mm_castpd_ps(
+            _mm_loadu_pd(reinterpret_cast<const double*>(&in[i].x)));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i),
+                         _mm_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+    }
+#endif
+    for(; i < n; ++i)
+        out[i] = {to_half(in[i].x), to_half(in[i].y)};
+}
+
+inline void pack_2_10_10_10(const glm::vec3* in, snorm_2_10_10_10* out,
+                            std::size_t n, float w)
+{
+    std::size_t i{0};
+#if defined(__AVX2__)
+    const __m128 wl = _mm_set_ps(w, 0.0f, 0.0f, 0.0f);
+    const __m128i mask = _mm_set_epi32(0x3, 0x3FF, 0x3FF, 0x3FF);
+    const __m128i shift = _mm_set_epi32(30, 20, 10, 0);
+    const __m128 scale = _mm_set_ps(1.0f, 511.0f, 511.0f, 511.0f);
+    for(; i + 1 < n; ++i)
+    {
+        auto v = _mm_min_ps(_mm_max_ps(load_xyz(in[i], wl),
+                                       _mm_set1_ps(-1.0f)),
+                            _mm_set1_ps(1.0f));
+        auto c = _mm_cvtps_epi32(_mm_mul_ps(v, scale));
+        c = _mm_sllv_epi32(_mm_and_si128(c, mask), shift);
+        c = _mm_or_si128(c, _mm_shuffle_epi32(c, _MM_SHUFFLE(1, 0, 3, 2)));
+        c = _mm_or_si128(c, _mm_shuffle_epi32(c, _MM_SHUFFLE(2, 3, 0, 1)));
+        out[i].bits = static_cast<GLuint>(_mm_cvtsi128_si32(c));
+    }
+#endif
+    for(; i < n; ++i)
+        out[i].bits = to_2_10_10_10(in[i].x, in[i].y, in[i].z, w);
+}
+
+// `out` has 4 components per vertex
+template<typename T>
+inline void pack_norm(const glm::vec3* in, T* out, std::size_t n, float w)
+{
+    static_assert(std::is_same<T, GLbyte>::value
+                  || std::is_same<T, GLshort>::value,
+                  "Only GLbyte and GLshort");
+    std::size_t i{0};
+#if defined(__SSE2__)
+    const __m128 wl = _mm_set_ps(w, 0.0f, 0.0f, 0.0f);
+    const float max = std::numeric_limits<T>::max();
+    // Two vertices per iteration
+    for(; i + 2 < n; i += 2)
+    {
+        auto s = _mm_packs_epi32(to_norm(load_xyz(in[i], wl), -1.0f, max),
+                                 to_norm(load_xyz(in[i + 1], wl), -1.0f,
+                                         max));
+        if(sizeof(T) == 2)
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4 * i), s);
+        else
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(out + 4 * i),
+                             _mm_packs_epi16(s, s));
+    }
+#endif
+    for(; i < n; ++i)
+    {
+        out[4 * i] = to_norm<T>(in[i].x);
+        out[4 * i + 1] = to_norm<T>(in[i].y);
+        out[4 * i + 2] = to_norm<T>(in[i].z);
+        out[4 * i + 3] = to_norm<T>(w);
+    }
+}
+
+inline void pack_unorm(const glm::vec4* in, GLubyte* out, std::size_t n)
+{
+    std::size_t i{0};
+#if defined(__SSE2__)
+    // Two vertices per iteration
+    for(; i + 2 <= n; i += 2)
+    {
+        auto s = _mm_packs_epi32(
+            to_norm(_mm_loadu_ps(&in[i].x), 0.0f, 255.0f),
+            to_norm(_mm_loadu_ps(&in[i + 1].x), 0.0f, 255.0f));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out + 4 * i),
+                         _mm_packus_epi16(s, s));
+    }
+#endif
+    for(; i < n; ++i)
+        for(int c{0}; c < 4; ++c)
+            out[4 * i + c] = to_norm<GLubyte>(in[i][c]);
+}
+
+}
+
+/// Convert [first, last) to half4 with w = `w`
+inline void pack(const glm::vec3* first, const glm::vec3* last,
+                 half4* out, float w = 0.0f)
+{ detail::pack_half(first, out, last - first, w); }
+
+/// Convert [first, last) to half2
+inline void pack(const glm::vec2* first, const glm::vec2* last,
+                 half2* out)
+{ detail::pack_half(first, out, last - first); }
+
+/// Convert [first, last), clamped to [-1, 1], to 2_10_10_10 with
+/// w = `w`(-1, 0 or 1)
+inline void pack(const glm::vec3* first, const glm::vec3* last,
+                 snorm_2_10_10_10* out, float w = 0.0f)
+{ detail::pack_2_10_10_10(first, out, last - first, w); }
+
+/// Convert [first, last), clamped to [-1, 1], to bytes with w = `w`
+inline void pack(const glm::vec3* first, const glm::vec3* last,
+                 normalized<glm::tvec4<GLbyte>>* out, float w = 0.0f)
+{
+    static_assert(sizeof(*out) == 4, "Unexpected padding");
+    detail::pack_norm(first, reinterpret_cast<GLbyte*>(out), last - first,
+                      w);
+}
+
+/// Convert [first, last), clamped to [-1, 1], to shorts with w = `w`
+inline void pack(const glm::vec3* first, const glm::vec3* last,
+                 normalized<glm::tvec4<GLshort>>* out, float w = 0.0f)
+{
+    static_assert(sizeof(*out) == 8, "Unexpected padding");
+    detail::pack_norm(first, reinterpret_cast<GLshort*>(out), last - first,
+                      w);
+}
+
+/// Convert [first, last), clamped to [0, 1], to unsigned bytes,
+/// e.g. colors
+inline void pack(const glm::vec4* first, const glm::vec4* last,
+                 normalized<glm::tvec4<GLubyte>>* out)
+{
+    static_assert(sizeof(*out) == 4, "Unexpected padding");
+    detail::pack_unorm(first, reinterpret_cast<GLubyte*>(out),
+                       last - first);
+}
+
+/// Return `v` converted to `Packed`
+///
+/// Example:
+///   freijo::VBO<freijo::half4> positions(
+///       freijo::pack<freijo::half4>(mesh.positions, 1.0f));
+template<typename Packed, typename Vec, typename... Args>
+inline std::vector<Packed> pack(const std::vector<Vec>& v, Args... args)
+{
+    std::vector<Packed> out(v.size());
+    pack(v.data(), v.data() + v.size(), out.data(), args...);
+    return out;
+}
+
+}
@@ -0,0 +1,320 @@
+
+// Copyright Ricardo Calheiros de Miranda Cosme 2017.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace freijo {
+
+/// GPU profiler of named zones measured with timestamp queries
+/// (Section 4.3 Time Queries at OpenGL 4.5 Core Profile)
+///
+/// Each zone issues glQueryCounter(GL_TIMESTAMP) at its beginning and
+/// at its end, so the zones can be nested, which isn't possible with
+/// GL_TIME_ELAPSED. The queries of a frame are only read when all of
+/// them are available (GL_QUERY_RESULT_AVAILABLE), typically a few
+/// frames later, so the profiler never waits for the GPU. The query
+/// objects are recycled through a pool.
+///
+/// Example:
+///
+///   freijo::gpu_profiler profiler;
+///   while(rendering)
+///   {
+///       profiler.begin_frame();
+///       {
+///           freijo::scoped_gpu_timer t(profiler, "shadows");
+///           ...
+///       }
+///       {
+///           freijo::scoped_gpu_timer t(profiler, "opaque");
+///           freijo::scoped_gpu_timer t2(profiler, "terrain");
+///           ...
+///       }
+///       profiler.end_frame();
+///   }
+///   std::ofstream out("trace.json");
+///   profiler.write_chrome_trace(out);
+///
+/// The names must live as long as the profiler, e.g. string literals.
+///
+class gpu_profiler
+{
+public:
+    /// Timing of a zone in nanoseconds of the GPU clock
+    struct zone
+    {
+        const char* name;
+
+        /// Nesting level, 0 for the outermost zones
+        std::size_t depth;
+
+        GLuint64 begin;
+        GLuint64 end;
+
+        GLuint64 duration() const noexcept { return end - begin; }
+    };
+
+    /// Zones of a frame in the order they began
+    struct frame
+    {
+        std::uint64_t index;
+        std::vector<zone> zones;
+    };
+
+    /// /param history Number of collected frames kept by frames().
+    /// /param latency Maximum number of frames waiting for their
+    ///                results. Older frames are dropped instead of
+    ///                waiting for the GPU.
+    explicit gpu_profiler(std::size_t history = 120,
+                          std::size_t latency = 8)
+        : _history(history)
+        , _latency(latency)
+    {}
+
+    ~gpu_profiler()
+    {
+        if(!_queries.empty())
+            glDeleteQueries(_queries.size(), _queries.data());
+    }
+
+    gpu_profiler(const gpu_profiler&) = delete;
+    gpu_profiler& operator=(const gpu_profiler&) = delete;
+
+    /// Collect the finished frames and start a new frame.
+    void begin_frame()
+    {
+        assert(!_recording);
+        collect();
+        _recording = true;
+        _current = pending_frame{_frames_begun++, {}};
+    }
+
+    /// End the current frame. Its results are collected by one of the
+    /// next calls to begin_frame() or collect().
+    ///
+    /// precondition: all the zones of the frame are closed
+    void end_frame()
+    {
+        assert(_recording && _open.empty());
+        _recording = false;
+        if(_current.zones.empty()) return;
+        _pending.push_back(std::move(_current));
+        if(_pending.size() > _latency)
+        {
+            release(_pending.front());
+            _pending.pop_front();
+            ++_dropped;
+        }
+    }
+
+    /// Open a zone named `name` inside the current frame
+    void begin_zone(const char* name)
+    {
+        assert(_recording);
+        pending_zone z{name, _open.size(), acquire(), acquire()};
+        glQueryCounter(z.begin, GL_TIMESTAMP);
+        _open.push_back(_current.zones.size());
+        _current.zones.push_back(z);
+    }
+
+    /// Close the innermost open zone
+    void end_zone()
+    {
+        assert(!_open.empty());
+        glQueryCounter(_current.zones[_open.back()].end, GL_TIMESTAMP);
+        _open.pop_back();
+    }
+
+    /// Read the results of the frames whose queries are available,
+    /// oldest first. It never blocks.
+    ///
+    /// /return Number of frames collected.
+    std::size_t collect()
+    {
+        std::size_t n{0};
+        while(!_pending.empty() && available(_pending.front()))
+        {
+            auto& p = _pending.front();
+            frame f{p.index, {}};
+            f.zones.reserve(p.zones.size());
+            for(auto& z : p.zones)
+            {
+                zone r{z.name, z.depth, 0, 0};
+                glGetQueryObjectui64v(z.begin, GL_QUERY_RESULT, &r.begin);
+                glGetQueryObjectui64v(z.end, GL_QUERY_RESULT, &r.end);
+                f.zones.push_back(r);
+            }
+            release(p);
+            _pending.pop_front();
+            _frames.push_back(std::move(f));
+            if(_frames.size() > _history) _frames.pop_front();
+            ++n;
+        }
+        return n;
+    }
+
+    /// Collected frames, oldest first
+    const std::deque<frame>& frames() const noexcept
+    { return _frames; }
+
+    /// Number of frames dropped because their results took too long
+    std::size_t dropped() const noexcept
+    { return _dropped; }
+
+    /// Forget the collected frames
+    void clear()
+    { _frames.clear(); }
+
+    /// Write the collected frames in the Chrome trace event format
+    /// (chrome://tracing or https://ui.perfetto.dev). Each frame is a
+    /// zone that contains the zones of the frame.
+    void write_chrome_trace(std::ostream& out) const
+    {
+        out << "{\"traceEvents\":[";
+        bool first{true};
+        for(auto& f : _frames)
+        {
+            if(f.zones.empty()) continue;
+            GLuint64 begin{f.zones.front().begin}, end{0};
+            for(auto& z : f.zones)
+            {
+                begin = std::min(begin, z.begin);
+                end = std::max(end, z.end);
+            }
+            write_event(out, first, "frame", f.index, begin, end);
+            for(auto& z : f.zones)
+                write_event(out, first, z.name, f.index, z.begin, z.end);
+        }
+        out << "],\"displayTimeUnit\":\"ns\"}\n";
+    }
+private:
+    struct pending_zone
+    {
+        const char* name;
+        std::size_t depth;
+        GLuint begin;
+        GLuint end;
+    };
+
+    struct pending_frame
+    {
+        std::uint64_t index;
+        std::vector<pending_zone> zones;
+    };
+
+    std::size_t _history;
+    std::size_t _latency;
+    bool _recording{false};
+    std::uint64_t _frames_begun{0};
+    std::size_t _dropped{0};
+    pending_frame _current;
+    std::vector<std::size_t> _open;
+    std::deque<pending_frame> _pending;
+    std::deque<frame> _frames;
+
+    // All the query objects and the free ones
+    std::vector<GLuint> _queries;
+    std::vector<GLuint> _free;
+
+    GLuint acquire()
+    {
+        if(_free.empty())
+        {
+            const std::size_t chunk{64};
+            auto n = _queries.size();
+            _queries.resize(n + chunk);
+            glGenQueries(chunk, _queries.data() + n);
+            _free.assign(_queries.begin() + n, _queries.end());
+        }
+        auto id = _free.back();
+        _free.pop_back();
+        return id;
+    }
+
+    void release(const pending_frame& f)
+    {
+        for(auto& z : f.zones)
+        {
+            _free.push_back(z.begin);
+            _free.push_back(z.end);
+        }
+    }
+
+    static bool available(const pending_frame& f)
+    {
+        for(auto& z : f.zones)
+        {
+            GLuint res{GL_FALSE};
+            glGetQueryObjectuiv(z.end, GL_QUERY_RESULT_AVAILABLE, &res);
+            if(!res) return false;
+        }
+        return true;
+    }
+
+    // Complete event("ph":"X") with the time in microseconds
+    static void write_event(std::ostream& out, bool& first,
+                            const char* name, std::uint64_t frame,
+                            GLuint64 begin, GLuint64 end)
+    {
+        if(!first) out << ",";
+        first = false;
+        out << "{\"name\":\"";
+        for(auto c = name; *c; ++c)
+        {
+            if(*c == '"' || *c == '\\') out << '\\';
+            out << *c;
+        }
+        out << "\",\"ph\":\"X\",\"pid\":0,\"tid\":0"
+            << ",\"ts\":" << microseconds(begin)
+            << ",\"dur\":" << microseconds(end - begin)
+            << ",\"args\":{\"frame\":" << frame << "}}";
+    }
+
+    // Nanoseconds as microseconds without losing precision
+    static std::string microseconds(GLuint64 ns)
+    {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%llu.%03llu",
+                      static_cast<unsigned long long>(ns / 1000),
+                      static_cast<unsigned long long>(ns % 1000));
+        return buf;
+    }
+};
+
+/// RAII to gpu_profiler::begin_zone and gpu_profiler::end_zone
+///
+/// Example:
+/// {
+///   scoped_gpu_timer t(profiler, "bloom"); //Opens the zone "bloom"
+///   ...
+/// } //Closes the zone "bloom"
+class scoped_gpu_timer
+{
+public:
+    scoped_gpu_timer(gpu_profiler& profiler, const char* name)
+        : _profiler(profiler)
+    { _profiler.begin_zone(name); }
+
+    ~scoped_gpu_timer()
+    { _profiler.end_zone(); }
+
+    scoped_gpu_timer(const scoped_gpu_timer&) = delete;
+    scoped_gpu_timer& operator=(const scoped_gpu_timer&) = delete;
+private:
+    gpu_profiler& _profiler;
+};
+
+}
@@ -6,16 +6,47 @@
 
 #pragma once
 
+#include "freijo/hash.hpp"
+#include "freijo/shader.hpp"
+#include "freijo/state.hpp"
+#include "freijo/uniform.hpp"
+
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
+#include <cstring>
 #include <stdexcept>
 #include <string>
 #include <vector>
 
 namespace freijo {
 
+/// Binary representation of a linked program
+/// (Section 2.11.3 Program Binaries at OpenGL 4.1 Core Profile)
+struct program_binary
+{
+    /// Implementation-defined format of `data`
+    GLenum format{0};
+
+    std::vector<char> data;
+};
+
 /// Abstraction to Program Objects
 /// (Section 2.11.2 Program Object at OpenGL 3.3 Core Profile)
 ///
+/// The active uniforms, attributes and uniform blocks are enumerated
+/// once after the link and kept in hash tables, so the locations are
+/// looked up without glGetUniformLocation. The names can be hashed at
+/// compile time:
+///
+///   using namespace freijo::literals;
+///   prog.set<"mvp"_h>(mvp);
+///   prog.set("color", glm::vec4(1));
+///
+/// The last value set to each uniform is remembered and a set() with
+/// the same value is elided. The shadow is wrong if the uniforms are
+/// changed by raw calls to glUniform*.
+///
 class program
 {
 public:
@@ -26,11 +57,20 @@ public:
     /// Create a program object(glCreateProgram), attach the
     /// `shaders`(glAttachShader) and link the program(glLinkProgram)
     ///
+    /// /param retrievable Hint that binary() will be called
+    ///                    (GL_PROGRAM_BINARY_RETRIEVABLE_HINT).
+    ///
     /// /throw std::runtime_error if a link error occurs
     ///
-    explicit program(Shaders shaders)
+    explicit program(Shaders shaders, bool retrievable = false)
+        : program(std::move(shaders), deferred, retrievable)
+    { check(); }
+
+    /// Create a program object and start the link without waiting for
+    /// it. check() must be called before using the program.
+    program(Shaders shaders, deferred_t, bool retrievable = false)
         : _id(glCreateProgram())
-        , _shaders(std::move(shaders))
+        , _shaders(shaders)
     {
         /// Section 2.11.2 - CreateProgram()
         /// "If an error occurs, zero will be returned"
@@ -39,35 +79,59 @@ public:
         //TODO: INVALID_OPERATION
         for(auto shader : _shaders)
             glAttachShader(_id, shader);
-        
+
+#ifdef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+        if(retrievable)
+            glProgramParameteri(_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                                GL_TRUE);
+#else
+        (void)retrievable;
+#endif
         glLinkProgram(_id);
+    }
+
+#ifdef GL_PROGRAM_BINARY_LENGTH
+    /// Create a program object from a binary returned by binary()
+    /// (glProgramBinary, OpenGL 4.1 or ARB_get_program_binary)
+    ///
+    /// /throw std::runtime_error if the binary is rejected, e.g. it
+    ///        was created by another driver.
+    ///
+    explicit program(const program_binary& binary)
+        : _id(glCreateProgram())
+    {
+        assert(_id);
+        glProgramBinary(_id, binary.format, binary.data.data(),
+                        binary.data.size());
         GLint linked;
         glGetProgramiv(_id, GL_LINK_STATUS, &linked);
         if(!linked)
         {
-            GLint length;
-            glGetProgramiv(_id, GL_INFO_LOG_LENGTH, &length);
-            std::vector<char> log(length);
-            glGetProgramInfoLog(_id, length, &length, log.data());
-            throw std::runtime_error("Program link error: "
-                                     + std::string(log.data()));
+            glDeleteProgram(_id);
+            throw std::runtime_error("Program binary rejected");
         }
+        reflect();
     }
-    
+#endif
+
     ~program()
     {
-        /// Free the program from the current context
-        glUseProgram(0);
-        
+        /// Free the program from the current context if it's in use
+        ///
         /// Section 2.11.3 - DeleteProgram()        
         /// "When a program object is deleted, all shader objects
         /// attached to it are detached."
-        glDeleteProgram(_id);
+        state().delete_program(_id);
     }
 
     program(program&& rhs)
         : _id(rhs._id)
         , _shaders(std::move(rhs._shaders))
+        , _uniforms(std::move(rhs._uniforms))
+        , _attribs(std::move(rhs._attribs))
+        , _blocks(std::move(rhs._blocks))
+        , _shadows(std::move(rhs._shadows))
+        , _values(std::move(rhs._values))
     {
         rhs._id = 0;
     }
@@ -77,6 +141,11 @@ public:
         _id = rhs._id;
         rhs._id = 0;
         _shaders = std::move(rhs._shaders);
+        _uniforms = std::move(rhs._uniforms);
+        _attribs = std::move(rhs._attribs);
+        _blocks = std::move(rhs._blocks);
+        _shadows = std::move(rhs._shadows);
+        _values = std::move(rhs._values);
         return *this;
     }
 
@@ -85,20 +154,260 @@ public:
     { return _id; }
 
     void use() const noexcept
-    { glUseProgram(_id); }
+    { state().use_program(_id); }
     
     ///Return the attached shaders
-    const Shaders& shaders() const noexcept
+    const std::vector<GLuint>& shaders() const noexcept
     { return _shaders; }
+
+#ifdef GL_PROGRAM_BINARY_LENGTH
+    /// Return the binary representation of the program
+    /// (glGetProgramBinary). The data is empty if the implementation
+    /// doesn't support any binary format.
+    program_binary binary() const
+    {
+        program_binary res;
+        GLint length{0};
+        glGetProgramiv(_id, GL_PROGRAM_BINARY_LENGTH, &length);
+        res.data.resize(length);
+        if(length)
+            glGetProgramBinary(_id, length, &length, &res.format,
+                               res.data.data());
+        res.data.resize(length);
+        return res;
+    }
+#endif
+
+    /// Return true if the link has finished, it never blocks
+    /// (GL_COMPLETION_STATUS_KHR). Without parallel compilation it's
+    /// always true.
+    bool ready() const
+    {
+        GLint done{GL_TRUE};
+        if(detail::parallel_shader_compile())
+            glGetProgramiv(_id, GL_COMPLETION_STATUS_KHR, &done);
+        return done == GL_TRUE;
+    }
+
+    /// Wait for the link and enumerate the active resources
+    ///
+    /// /throw std::runtime_error if a compilation error of an
+    ///        attached shader or a link error occurs
+    ///
+    void check()
+    {
+        GLint linked;
+        glGetProgramiv(_id, GL_LINK_STATUS, &linked);
+        if(!linked)
+        {
+            // A compilation error is more useful than the link error
+            // that it causes.
+            GLint count{0};
+            glGetProgramiv(_id, GL_ATTACHED_SHADERS, &count);
+            std::vector<GLuint> shaders(count);
+            if(count)
+                glGetAttachedShaders(_id, count, &count, shaders.data());
+            for(auto shader : shaders)
+            {
+                GLint type;
+                glGetShaderiv(shader, GL_SHADER_TYPE, &type);
+                detail::check_shader(shader, detail::shader_name(type));
+            }
+
+            GLint length;
+            glGetProgramiv(_id, GL_INFO_LOG_LENGTH, &length);
+            std::vector<char> log(length + 1);
+            glGetProgramInfoLog(_id, length, &length, log.data());
+            throw std::runtime_error("Program link error: "
+                                     + std::string(log.data()));
+        }
+        reflect();
+    }
+
+    /// Return the location of the uniform `name` or -1 if it isn't
+    /// active. The uniforms of blocks don't have locations.
+    GLint uniform(const char* name) const noexcept
+    { return location(_uniforms.find(name)); }
+
+    /// Return the location of the uniform with the hash `Hash`, e.g.
+    /// uniform<"mvp"_h>(), or -1 if it isn't active.
+    template<std::uint32_t Hash>
+    GLint uniform() const noexcept
+    { return location(_uniforms.find(Hash)); }
+
+    /// Return the location of the attribute `name` or -1 if it isn't
+    /// active.
+    GLint attrib(const char* name) const noexcept
+    { return location(_attribs.find(name)); }
+
+    template<std::uint32_t Hash>
+    GLint attrib() const noexcept
+    { return location(_attribs.find(Hash)); }
+
+    /// Return the index of the uniform block `name` or
+    /// GL_INVALID_INDEX if it isn't active.
+    GLuint uniform_block(const char* name) const noexcept
+    { return block_index(_blocks.find(name)); }
+
+    template<std::uint32_t Hash>
+    GLuint uniform_block() const noexcept
+    { return block_index(_blocks.find(Hash)); }
+
+    /// Assign the binding point `binding` to the uniform block `name`
+    /// (glUniformBlockBinding). Nothing is done if the block isn't active.
+    void bind_uniform_block(const char* name, GLuint binding) const
+    {
+        auto index = uniform_block(name);
+        if(index != GL_INVALID_INDEX)
+            glUniformBlockBinding(_id, index, binding);
+    }
+
+    /// Set the uniform `name` to `value`. Nothing is done if the
+    /// uniform isn't active or if it already has `value`.
+    ///
+    /// Without FREIJO_DSA the program is put in use.
+    ///
+    /// /throw std::runtime_error if a `T` can't be set to the type of
+    ///        the uniform(see detail::uniform_accepts)
+    template<typename T>
+    void set(const char* name, const T& value)
+    { set_uniform(_uniforms.find(name), &value, 1); }
+
+    /// Set the uniform with the hash `Hash` to `value`
+    template<std::uint32_t Hash, typename T>
+    void set(const T& value)
+    { set_uniform(_uniforms.find(Hash), &value, 1); }
+
+    /// Set the first `count` elements of the uniform array `name`.
+    /// `count` is clamped to the length of the array.
+    template<typename T>
+    void set(const char* name, const T* values, GLsizei count)
+    { set_uniform(_uniforms.find(name), values, count); }
+
+    template<std::uint32_t Hash, typename T>
+    void set(const T* values, GLsizei count)
+    { set_uniform(_uniforms.find(Hash), values, count); }
 private:
+    // Last value set to a uniform: [offset, offset + known) of _values.
+    // The slot of the uniform is [offset, offset + capacity).
+    struct shadow
+    {
+        std::size_t offset;
+        std::size_t known;
+        std::size_t capacity;
+    };
+
     GLuint _id{0};
-    Shaders _shaders;
+    // Copy of the list, it doesn't own the array of the arguments
+    std::vector<GLuint> _shaders;
+    detail::resource_table _uniforms;
+    detail::resource_table _attribs;
+    detail::resource_table _blocks;
+    std::vector<shadow> _shadows;
+    std::vector<unsigned char> _values;
+
+    static GLint location(const detail::resource* r) noexcept
+    { return r ? r->location : -1; }
+
+    static GLuint block_index(const detail::resource* r) noexcept
+    { return r ? static_cast<GLuint>(r->location) : GL_INVALID_INDEX; }
+
+    template<typename T>
+    void set_uniform(const detail::resource* r, const T* values,
+                     GLsizei count)
+    {
+        if(!r || count <= 0) return;
+        auto& s = _shadows[r->shadow];
+        // A value that GL rejects(GL_INVALID_OPERATION) must not
+        // change the shadow.
+        if(!detail::uniform_accepts(r->type, UniformTraits<T>::type))
+            throw std::runtime_error("The type of the value doesn't match "
+                                     "the type of the uniform");
+        // GL ignores the elements past the end of the array
+        count = std::min(count, r->size);
+        auto bytes = sizeof(T) * count;
+        assert(bytes <= s.capacity);
+        auto last = _values.data() + s.offset;
+        if(bytes <= s.known && std::memcmp(last, values, bytes) == 0)
+            return;
+        std::memcpy(last, values, bytes);
+        s.known = std::max(s.known, bytes);
+#ifndef FREIJO_DSA
+        use();
+#endif
+        UniformTraits<T>::upload(_id, r->location, count, values);
+    }
+
+    // Section 2.11.4 - GetActiveUniform(), GetActiveAttrib() and
+    // GetActiveUniformBlockName()
+    void reflect()
+    {
+        _shadows.clear();
+        _values.clear();
+        GLint count{0}, length{0};
+        std::vector<char> name;
+
+        glGetProgramiv(_id, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(_id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &length);
+        name.resize(std::max(length, 1));
+        // An array is also found by its name without "[0]"
+        _uniforms.reserve(2 * count);
+        for(GLint i{0}; i < count; ++i)
+        {
+            detail::resource r;
+            glGetActiveUniform(_id, i, name.size(), nullptr, &r.size,
+                               &r.type, name.data());
+            r.location = glGetUniformLocation(_id, name.data());
+            if(r.location < 0) continue;
+            r.shadow = _shadows.size();
+            auto element = detail::uniform_bytes(r.type);
+            _shadows.push_back(shadow{_values.size(), 0,
+                                      element * r.size});
+            _values.resize(_values.size() + element * r.size);
+            std::string s(name.data());
+            _uniforms.insert(s, r);
+            if(s.size() > 3 && s.compare(s.size() - 3, 3, "[0]") == 0)
+                _uniforms.insert(s.substr(0, s.size() - 3), r);
+        }
+
+        glGetProgramiv(_id, GL_ACTIVE_ATTRIBUTES, &count);
+        glGetProgramiv(_id, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &length);
+        name.resize(std::max(length, 1));
+        _attribs.reserve(count);
+        for(GLint i{0}; i < count; ++i)
+        {
+            detail::resource r;
+            glGetActiveAttrib(_id, i, name.size(), nullptr, &r.size,
+                              &r.type, name.data());
+            r.location = glGetAttribLocation(_id, name.data());
+            // Built-ins(gl_VertexID, ...) don't have locations
+            if(r.location < 0) continue;
+            _attribs.insert(name.data(), r);
+        }
+
+        glGetProgramiv(_id, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+        glGetProgramiv(_id, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH,
+                       &length);
+        name.resize(std::max(length, 1));
+        _blocks.reserve(count);
+        for(GLint i{0}; i < count; ++i)
+        {
+            detail::resource r;
+            glGetActiveUniformBlockName(_id, i, name.size(), nullptr,
+                                        name.data());
+            glGetActiveUniformBlockiv(_id, i, GL_UNIFORM_BLOCK_DATA_SIZE,
+                                      &r.size);
+            r.location = i;
+            _blocks.insert(name.data(), r);
+        }
+    }
 };
 
 inline bool operator==(const program& lhs,
                        const program& rhs)
 {
     return lhs.id() == rhs.id()
+        && lhs.shaders().size() == rhs.shaders().size()
         && std::equal(lhs.shaders().begin(), lhs.shaders().end(),
                       rhs.shaders().begin());
 }
@@ -0,0 +1,184 @@
+
+// Copyright Ricardo Calheiros de Miranda Cosme 2017.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "freijo/hash.hpp"
+#include "freijo/program.hpp"
+#include "freijo/shader.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace freijo {
+
+/// On-disk cache of program binaries
+/// (Section 2.11.3 Program Binaries at OpenGL 4.1 Core Profile)
+///
+/// A program is identified by a hash of the sources of its shaders
+/// and of the vendor, the renderer and the version of the driver. On
+/// a hit the program is loaded with glProgramBinary and the shaders
+/// aren't compiled. On a miss, or if the driver rejects the binary
+/// (e.g. after an update), the program is compiled and linked from
+/// the sources and its binary is written to the directory.
+///
+/// Example:
+///
+///   freijo::program_cache cache("shaders.cache");
+///   auto prog = cache.get(freijo::vertex_source{vs},
+///                         freijo::fragment_source{fs});
+///
+/// The directory must exist. Failures to read or write the files
+/// aren't errors, the program is just compiled.
+///
+class program_cache
+{
+public:
+    struct statistics
+    {
+        /// Number of programs loaded from a binary
+        std::size_t hits{0};
+
+        /// Number of programs compiled from the sources
+        std::size_t misses{0};
+
+        /// Number of binaries rejected by the driver, also counted
+        /// as misses
+        std::size_t rejected{0};
+
+        /// Number of binaries written to the directory
+        std::size_t stored{0};
+    };
+
+    /// /param directory Directory of the binaries.
+    explicit program_cache(std::string directory)
+        : _directory(std::move(directory))
+    {
+        GLint formats{0};
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        _enabled = formats > 0;
+        for(auto name : {GL_VENDOR, GL_RENDERER, GL_VERSION})
+        {
+            auto s = reinterpret_cast<const char*>(glGetString(name));
+            if(s) _driver = fnv1a64(s, std::char_traits<char>::length(s),
+                                    _driver);
+        }
+    }
+
+    /// Return the program linked from the `sources`
+    ///
+    /// /throw std::runtime_error if a compile or link error occurs
+    ///
+    template<typename... Types>
+    program get(const shader_source<Types>&... sources)
+    {
+        auto key = _driver;
+        hash_sources(key, sources...);
+        auto path = file(key);
+
+        program_binary binary;
+        if(_enabled && load(path, key, binary))
+        {
+            try
+            {
+                program res(binary);
+                ++_stats.hits;
+                return res;
+            }
+            catch(const std::runtime_error&)
+            { ++_stats.rejected; }
+        }
+
+        ++_stats.misses;
+        program res({shader<Types>(sources.code).id()...}, _enabled);
+        if(_enabled && store(path, key, res.binary()))
+            ++_stats.stored;
+        return res;
+    }
+
+    const statistics& stats() const noexcept
+    { return _stats; }
+
+    void reset_stats() noexcept
+    { _stats = statistics{}; }
+
+    /// Return false if the implementation doesn't support any binary
+    /// format, so all the programs are compiled.
+    bool enabled() const noexcept
+    { return _enabled; }
+private:
+    struct header
+    {
+        char magic[4];
+        std::uint64_t key;
+        GLenum format;
+    };
+
+    std::string _directory;
+    std::uint64_t _driver{14695981039346656037ull};
+    bool _enabled{false};
+    statistics _stats;
+
+    static void hash_sources(std::uint64_t&) {}
+
+    template<typename Type, typename... Types>
+    static void hash_sources(std::uint64_t& key,
+                             const shader_source<Type>& source,
+                             const shader_source<Types>&... sources)
+    {
+        auto type = Type::glType;
+        key = fnv1a64(&type, sizeof(type), key);
+        key = fnv1a64(source.code.data(), source.code.size(), key);
+        hash_sources(key, sources...);
+    }
+
+    std::string file(std::uint64_t key) const
+    {
+        char name[17];
+        std::snprintf(name, sizeof(name), "%016llx",
+                      static_cast<unsigned long long>(key));
+        return _directory + "/" + name + ".bin";
+    }
+
+    static bool load(const std::string& path, std::uint64_t key,
+                     program_binary& binary)
+    {
+        std::ifstream in(path, std::ios::binary);
+        header h;
+        if(!in.read(reinterpret_cast<char*>(&h), sizeof(h))
+           || std::string(h.magic, 4) != "FRJB" || h.key != key)
+            return false;
+        binary.format = h.format;
+        binary.data.assign(std::istreambuf_iterator<char>(in),
+                           std::istreambuf_iterator<char>());
+        return !binary.data.empty();
+    }
+
+    // The binary is written to a temporary file and renamed, so a
+    // crash doesn't leave a truncated binary.
+    static bool store(const std::string& path, std::uint64_t key,
+                      const program_binary& binary)
+    {
+        if(binary.data.empty()) return false;
+        auto tmp = path + ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+            header h{{'F', 'R', 'J', 'B'}, key, binary.format};
+            out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+            out.write(binary.data.data(), binary.data.size());
+            if(!out) return false;
+        }
+        return std::rename(tmp.c_str(), path.c_str()) == 0;
+    }
+};
+
+}
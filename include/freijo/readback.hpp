@@ -0,0 +1,222 @@
+
+// Copyright Ricardo Calheiros de Miranda Cosme 2017.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "freijo/buffer.hpp"
+#include "freijo/fence.hpp"
+#include "freijo/state.hpp"
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace freijo {
+
+namespace detail {
+
+/// Number of bytes of a pixel in client memory
+/// (Section 8.4.4 Transfer of Pixel Rectangles at OpenGL 4.5 Core
+/// Profile)
+inline std::size_t pixel_bytes(GLenum format, GLenum type)
+{
+    std::size_t components{4};
+    switch(format)
+    {
+    case GL_RED: case GL_GREEN: case GL_BLUE:
+    case GL_RED_INTEGER: case GL_DEPTH_COMPONENT: case GL_STENCIL_INDEX:
+        components = 1;
+        break;
+    case GL_RG: case GL_RG_INTEGER:
+        components = 2;
+        break;
+    case GL_RGB: case GL_BGR: case GL_RGB_INTEGER: case GL_BGR_INTEGER:
+        components = 3;
+        break;
+    }
+    switch(type)
+    {
+    case GL_UNSIGNED_BYTE: case GL_BYTE:
+        return components;
+    case GL_UNSIGNED_SHORT: case GL_SHORT: case GL_HALF_FLOAT:
+        return 2 * components;
+    case GL_UNSIGNED_INT: case GL_INT: case GL_FLOAT:
+        return 4 * components;
+    }
+    // Packed types(GL_UNSIGNED_INT_8_8_8_8_REV,
+    // GL_UNSIGNED_INT_2_10_10_10_REV, GL_UNSIGNED_INT_24_8, ...)
+    return 4;
+}
+
+}
+
+/// Asynchronous readback of the framebuffer through a ring of pixel
+/// pack buffers
+///
+/// read() starts a glReadPixels into the PBO of the next slot and
+/// returns at once, the transfer is done by the GPU after the
+/// commands that render the frame. A fence marks the end of the
+/// transfer, and poll() hands the completed frames to the callback in
+/// the order they were read. With `frames` slots the CPU only waits
+/// when `frames` reads are in flight, which is counted by `stalls()`.
+///
+/// Example:
+///
+///   freijo::readback_queue queue(1920, 1080, GL_RGBA, GL_UNSIGNED_BYTE,
+///       3, [&](const freijo::readback_queue::frame& f)
+///          { encoder.push(f.pixels, f.stride); });
+///   while(rendering)
+///   {
+///       render();
+///       queue.read();
+///       queue.poll();
+///   }
+///   queue.flush();
+///
+/// The pixels are read with the current GL_PACK_ALIGNMENT from the
+/// framebuffer bound to GL_READ_FRAMEBUFFER.
+///
+class readback_queue
+{
+public:
+    /// Pixels of a completed read. The pointer is valid only during
+    /// the callback.
+    struct frame
+    {
+        /// Number of the read, starting at 0
+        std::uint64_t index;
+
+        const void* pixels;
+
+        /// Number of bytes of `pixels`
+        std::size_t size;
+
+        /// Number of bytes of a row of pixels
+        std::size_t stride;
+    };
+
+    using callback = std::function<void(const frame&)>;
+
+    /// /param width Width of the rectangle read by each frame.
+    /// /param height Height of the rectangle read by each frame.
+    /// /param format Format of the pixels, e.g. GL_RGBA.
+    /// /param type Type of the pixels, e.g. GL_UNSIGNED_BYTE.
+    /// /param frames Maximum number of reads in flight.
+    /// /param f Callback called by poll() and flush().
+    readback_queue(GLsizei width, GLsizei height, GLenum format,
+                   GLenum type, std::size_t frames, callback f)
+        : _width(width)
+        , _height(height)
+        , _format(format)
+        , _type(type)
+        , _callback(std::move(f))
+    {
+        assert(frames > 0);
+        GLint alignment{4};
+        glGetIntegerv(GL_PACK_ALIGNMENT, &alignment);
+        auto row = detail::pixel_bytes(format, type) * width;
+        _stride = (row + alignment - 1) / alignment * alignment;
+        _slots.reserve(frames);
+        for(std::size_t i{0}; i < frames; ++i)
+            _slots.emplace_back(_stride * height);
+    }
+
+    readback_queue(const readback_queue&) = delete;
+    readback_queue& operator=(const readback_queue&) = delete;
+
+    /// Start the read of the rectangle of `width` x `height` pixels at
+    /// (x, y). If all the slots are in flight, the oldest one is
+    /// waited and delivered first.
+    void read(GLint x = 0, GLint y = 0)
+    {
+        if(_count == _slots.size())
+        {
+            // Only a wait for the GPU is a stall, not a full ring whose
+            // oldest read is already complete.
+            if(!_slots[_head].done.signaled()) ++_stalls;
+            deliver();
+        }
+        auto& s = _slots[(_head + _count) % _slots.size()];
+        {
+            scoped_target_buffer_bind bbg(GL_PIXEL_PACK_BUFFER, s.pbo.id());
+            glReadPixels(x, y, _width, _height, _format, _type, nullptr);
+        }
+        s.done.set();
+        s.index = _reads++;
+        ++_count;
+        // The fence must reach the GPU to be signaled without a wait
+        // with GL_SYNC_FLUSH_COMMANDS_BIT.
+        glFlush();
+    }
+
+    /// Deliver the completed reads without blocking
+    ///
+    /// /return Number of frames delivered.
+    std::size_t poll()
+    {
+        std::size_t n{0};
+        for(; _count && _slots[_head].done.signaled(); ++n)
+            deliver();
+        return n;
+    }
+
+    /// Wait for and deliver all the reads in flight
+    void flush()
+    {
+        while(_count) deliver();
+    }
+
+    /// Number of reads in flight
+    std::size_t in_flight() const noexcept { return _count; }
+
+    /// Number of times that read() waited for the GPU
+    std::size_t stalls() const noexcept { return _stalls; }
+
+    /// Number of bytes of a row of pixels
+    std::size_t stride() const noexcept { return _stride; }
+private:
+    struct slot
+    {
+        explicit slot(std::size_t size)
+            : pbo(size, GL_STREAM_READ)
+        {}
+
+        PBO_pack<GLubyte> pbo;
+        fence done;
+        std::uint64_t index{0};
+    };
+
+    GLsizei _width;
+    GLsizei _height;
+    GLenum _format;
+    GLenum _type;
+    callback _callback;
+    std::size_t _stride{0};
+    std::vector<slot> _slots;
+
+    // Oldest read in flight and number of reads in flight
+    std::size_t _head{0};
+    std::size_t _count{0};
+    std::uint64_t _reads{0};
+    std::size_t _stalls{0};
+
+    void deliver()
+    {
+        auto& s = _slots[_head];
+        s.done.wait();
+        s.done.reset();
+        auto pixels = s.pbo.map(GL_READ_ONLY);
+        if(pixels && _callback)
+            _callback(frame{s.index, pixels, s.pbo.size(), _stride});
+        s.pbo.unmap();
+        _head = (_head + 1) % _slots.size();
+        --_count;
+    }
+};
+
+}
@@ -0,0 +1,429 @@
+
+// Copyright Ricardo Calheiros de Miranda Cosme 2017.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "freijo/VAO.hpp"
+#include "freijo/buffer_arena.hpp"
+#include "freijo/index_buffer.hpp"
+#include "freijo/program.hpp"
+#include "freijo/state.hpp"
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+namespace freijo {
+
+namespace detail {
+
+// Capabilities managed by the render_queue, one bit of enable_set each
+constexpr std::array<GLenum, 16> queue_capabilities{{
+    GL_BLEND, GL_CULL_FACE, GL_DEPTH_TEST, GL_STENCIL_TEST,
+    GL_SCISSOR_TEST, GL_POLYGON_OFFSET_FILL, GL_POLYGON_OFFSET_LINE,
+    GL_SAMPLE_ALPHA_TO_COVERAGE, GL_SAMPLE_COVERAGE, GL_PRIMITIVE_RESTART,
+    GL_RASTERIZER_DISCARD, GL_FRAMEBUFFER_SRGB, GL_DEPTH_CLAMP,
+    GL_PROGRAM_POINT_SIZE, GL_LINE_SMOOTH, GL_CLIP_DISTANCE0}};
+
+inline std::uint16_t capability_bit(GLenum cap)
+{
+    for(std::size_t i{0}; i < queue_capabilities.size(); ++i)
+        if(queue_capabilities[i] == cap)
+            return static_cast<std::uint16_t>(1u << i);
+    assert(false && "capability not managed by the render_queue");
+    return 0;
+}
+
+struct sort_item
+{
+    std::uint64_t key;
+    std::uint32_t index;
+};
+
+// Stable LSD radix sort of `items` by key, one byte per pass. The
+// passes where all the keys have the same byte are skipped.
+inline void radix_sort(std::vector<sort_item>& items,
+                       std::vector<sort_item>& tmp)
+{
+    std::size_t counts[8][256] = {};
+    for(auto& item : items)
+        for(std::size_t b{0}; b < 8; ++b)
+            ++counts[b][(item.key >> (8 * b)) & 0xFF];
+    tmp.resize(items.size());
+    for(std::size_t b{0}; b < 8; ++b)
+    {
+        auto& count = counts[b];
+        if(count[(items[0].key >> (8 * b)) & 0xFF] == items.size())
+            continue;
+        std::size_t offset{0};
+        for(auto& c : count)
+        {
+            auto n = c;
+            c = offset;
+            offset += n;
+        }
+        for(auto& item : items)
+            tmp[count[(item.key >> (8 * b)) & 0xFF]++] = item;
+        items.swap(tmp);
+    }
+}
+
+}
+
+/// Set of capabilities enabled(glEnable) for a draw of a render_queue
+///
+/// Only the capabilities in detail::queue_capabilities can be in the
+/// set, e.g. GL_BLEND, GL_CULL_FACE, GL_DEPTH_TEST or
+/// GL_STENCIL_TEST. The ones that aren't in the set are disabled.
+class enable_set
+{
+public:
+    enable_set() = default;
+
+    enable_set(std::initializer_list<GLenum> caps)
+    { for(auto cap : caps) _bits |= detail::capability_bit(cap); }
+
+    bool contains(GLenum cap) const
+    { return _bits & detail::capability_bit(cap); }
+
+    std::uint16_t bits() const noexcept { return _bits; }
+private:
+    std::uint16_t _bits{0};
+};
+
+/// State shared by the draws of a render_queue: the program, the VAO,
+/// the enabled capabilities and the layer. The layers are drawn in
+/// increasing order, e.g. 0 for the opaque draws and 1 for the
+/// transparent ones.
+///
+/// precondition: layer < 16
+struct render_state
+{
+    render_state(const program& prog, const VAO_base& vao,
+                 enable_set enables = {}, unsigned layer = 0)
+        : program(prog.id())
+        , vao(vao.id())
+        , enables(enables)
+        , layer(layer)
+    { assert(layer < 16); }
+
+    GLuint program;
+    GLuint vao;
+    enable_set enables;
+    unsigned layer;
+};
+
+/// Draw recorded by a render_queue or a command_list
+struct render_command
+{
+    GLuint program;
+    GLuint vao;
+    std::uint16_t enables;
+    GLenum mode;
+
+    /// Type of the indices, or 0 to glDrawArrays
+    GLenum type;
+
+    GLsizei count;
+    GLsizei instances;
+    GLint base_vertex;
+
+    /// First vertex, or offset in bytes of the first index
+    std::uintptr_t first;
+};
+
+/// Number of draws and state transitions issued by a render_queue or
+/// a command_queue
+struct render_statistics
+{
+    std::size_t draws{0};
+
+    /// Number of transitions issued
+    std::size_t programs{0};
+    std::size_t vertex_arrays{0};
+    std::size_t capabilities{0};
+};
+
+namespace detail {
+
+inline render_command make_command(const render_state& s, GLenum mode,
+                                   GLenum type, std::size_t count,
+                                   GLsizei instances, GLint base_vertex,
+                                   std::uintptr_t first)
+{
+    return render_command{s.program, s.vao, s.enables.bits(), mode, type,
+                          static_cast<GLsizei>(count), instances,
+                          base_vertex, first};
+}
+
+template<typename VBO>
+render_command arrays_command(const render_state& s, GLenum mode,
+                              const VBO& vbo, GLsizei instances)
+{ return make_command(s, mode, 0, vbo.size(), instances, 0, 0); }
+
+template<typename T, typename Target>
+render_command arrays_command(const render_state& s, GLenum mode,
+                              const buffer_slice<T, Target>& vbo,
+                              GLsizei instances)
+{ return make_command(s, mode, 0, vbo.size(), instances, 0, vbo.first()); }
+
+template<typename EBO>
+render_command elements_command(const render_state& s, GLenum mode,
+                                const EBO& ebo, GLsizei instances)
+{
+    return make_command(s, mode, EBO::target::GLtype, ebo.size(),
+                        instances, 0, 0);
+}
+
+inline render_command elements_command(const render_state& s, GLenum mode,
+                                       const index_buffer& ebo,
+                                       GLsizei instances)
+{ return make_command(s, mode, ebo.type(), ebo.size(), instances, 0, 0); }
+
+template<typename I, typename ITarget, typename T, typename Target>
+render_command elements_command(const render_state& s, GLenum mode,
+                                const buffer_slice<I, ITarget>& ebo,
+                                const buffer_slice<T, Target>& vbo,
+                                GLsizei instances)
+{
+    return make_command(s, mode, ITarget::GLtype, ebo.size(), instances,
+                        vbo.first(), ebo.offset());
+}
+
+// Issue render_commands, with only the transitions of program, VAO
+// and capabilities between consecutive commands
+class render_player
+{
+public:
+    // Start a sequence of commands
+    void begin()
+    {
+        _first = true;
+        if(!_known) query();
+    }
+
+    void play(const render_command& c)
+    {
+        if(_first || c.program != _program)
+        {
+            state().use_program(c.program);
+            _program = c.program;
+            ++_stats.programs;
+        }
+        if(_first || c.vao != _vao)
+        {
+            state().bind_vertex_array(c.vao);
+            _vao = c.vao;
+            ++_stats.vertex_arrays;
+        }
+        _first = false;
+        if(c.enables != _enabled) apply(c.enables);
+        draw(c);
+        ++_stats.draws;
+    }
+
+    void invalidate() noexcept
+    { _known = false; }
+
+    const render_statistics& stats() const noexcept
+    { return _stats; }
+
+    void reset_stats() noexcept
+    { _stats = render_statistics{}; }
+private:
+    GLuint _program{0};
+    GLuint _vao{0};
+    std::uint16_t _enabled{0};
+    bool _first{true};
+    bool _known{false};
+    render_statistics _stats;
+
+    void query()
+    {
+        _enabled = 0;
+        for(std::size_t i{0}; i < queue_capabilities.size(); ++i)
+            if(glIsEnabled(queue_capabilities[i]))
+                _enabled |= static_cast<std::uint16_t>(1u << i);
+        _known = true;
+    }
+
+    void apply(std::uint16_t enables)
+    {
+        unsigned diff = enables ^ _enabled;
+        for(std::size_t i{0}; diff; ++i, diff >>= 1)
+        {
+            if(!(diff & 1)) continue;
+            if(enables & (1u << i))
+                glEnable(queue_capabilities[i]);
+            else
+                glDisable(queue_capabilities[i]);
+            ++_stats.capabilities;
+        }
+        _enabled = enables;
+    }
+
+    static void draw(const render_command& c)
+    {
+        if(!c.type)
+        {
+            if(c.instances == 1)
+                glDrawArrays(c.mode, c.first, c.count);
+            else
+                glDrawArraysInstanced(c.mode, c.first, c.count,
+                                      c.instances);
+            return;
+        }
+        auto indices = reinterpret_cast<const void*>(c.first);
+        if(c.instances == 1)
+            glDrawElementsBaseVertex(c.mode, c.count, c.type, indices,
+                                     c.base_vertex);
+        else
+            glDrawElementsInstancedBaseVertex(c.mode, c.count, c.type,
+                                              indices, c.instances,
+                                              c.base_vertex);
+    }
+};
+
+}
+
+/// Queue of draws sorted to minimise the changes of state
+///
+/// The draws are recorded as render_commands with a 64-bit sort key
+/// and submit() radix sorts them and issues only the transitions that
+/// change the state: glUseProgram, glBindVertexArray and the
+/// glEnable/glDisable of the capabilities of enable_set. From the most
+/// to the least significant bits the key holds:
+///
+///   layer(4) | program(14) | enables(16) | VAO(14) | depth(16)
+///
+/// The program and the VAO take the low bits of their names. Names
+/// are small integers in practice, two names that collide only make
+/// their draws interleave. The draws with equal keys keep the order
+/// of recording. The depth is given by the caller, e.g. the quantised
+/// distance to the camera to draw front to back.
+///
+/// Example:
+///
+///   freijo::render_queue queue;
+///   freijo::render_state opaque{program, vao, {GL_DEPTH_TEST, GL_CULL_FACE}};
+///   for(auto& mesh : meshes)
+///       queue.draw_elements(opaque, GL_TRIANGLES, mesh.indices, mesh.vertices);
+///   queue.submit();
+///
+/// The queue remembers the capabilities that it enabled between
+/// submits, invalidate() must be called if they are changed without
+/// the queue(e.g. by freijo::enable).
+///
+class render_queue
+{
+public:
+    using statistics = render_statistics;
+
+    render_queue() = default;
+
+    /// Reserve space to `n` draws
+    explicit render_queue(std::size_t n)
+    {
+        _commands.reserve(n);
+        _items.reserve(n);
+        _tmp.reserve(n);
+    }
+
+    render_queue(const render_queue&) = delete;
+    render_queue& operator=(const render_queue&) = delete;
+
+    /// Record `cmd` at the position `depth` of its state
+    void record(const render_command& cmd, unsigned layer,
+                std::uint16_t depth = 0)
+    {
+        assert(layer < 16);
+        std::uint64_t key =
+            std::uint64_t(layer) << 60
+            | std::uint64_t(cmd.program & 0x3FFF) << 46
+            | std::uint64_t(cmd.enables) << 30
+            | std::uint64_t(cmd.vao & 0x3FFF) << 16
+            | depth;
+        _items.push_back(detail::sort_item{
+            key, static_cast<std::uint32_t>(_commands.size())});
+        _commands.push_back(cmd);
+    }
+
+    /// glDrawArrays with all the vertices of `vbo`
+    template<typename VBO>
+    void draw_arrays(const render_state& s, GLenum mode, const VBO& vbo,
+                     GLsizei instances = 1, std::uint16_t depth = 0)
+    { record(detail::arrays_command(s, mode, vbo, instances), s.layer,
+             depth); }
+
+    /// glDrawElements with all the indices of `ebo`
+    ///
+    /// precondition: `ebo` is attached to the VAO
+    template<typename EBO>
+    void draw_elements(const render_state& s, GLenum mode, const EBO& ebo,
+                       GLsizei instances = 1, std::uint16_t depth = 0)
+    { record(detail::elements_command(s, mode, ebo, instances), s.layer,
+             depth); }
+
+    /// glDrawElementsBaseVertex with the indices of `ebo`, relative to
+    /// the first vertex of `vbo`
+    ///
+    /// precondition: the arenas of `ebo` and `vbo` are attached to the
+    ///               VAO
+    template<typename I, typename ITarget, typename T, typename Target>
+    void draw_elements(const render_state& s, GLenum mode,
+                       const buffer_slice<I, ITarget>& ebo,
+                       const buffer_slice<T, Target>& vbo,
+                       GLsizei instances = 1, std::uint16_t depth = 0)
+    { record(detail::elements_command(s, mode, ebo, vbo, instances),
+             s.layer, depth); }
+
+    /// Sort and draw all the recorded commands, and clear the queue.
+    ///
+    /// The program, the VAO and the capabilities of the last draw are
+    /// left in the context.
+    void submit()
+    {
+        if(_items.empty()) return;
+        detail::radix_sort(_items, _tmp);
+        _player.begin();
+        for(auto& item : _items)
+            _player.play(_commands[item.index]);
+        clear();
+    }
+
+    /// Drop the recorded commands
+    void clear()
+    {
+        _commands.clear();
+        _items.clear();
+    }
+
+    /// Forget the capabilities enabled by the queue, they are queried
+    /// on the next submit().
+    void invalidate() noexcept
+    { _player.invalidate(); }
+
+    /// Number of recorded commands
+    std::size_t size() const noexcept { return _commands.size(); }
+
+    bool empty() const noexcept { return _commands.empty(); }
+
+    const statistics& stats() const noexcept
+    { return _player.stats(); }
+
+    void reset_stats() noexcept
+    { _player.reset_stats(); }
+private:
+    std::vector<render_command> _commands;
+    std::vector<detail::sort_item> _items;
+    std::vector<detail::sort_item> _tmp;
+    detail::render_player _player;
+};
+
+}
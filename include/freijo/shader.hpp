@@ -6,6 +6,9 @@
 
 #pragma once
 
+#include "freijo/extension.hpp"
+#include "freijo/state.hpp"
+
 #include <cassert>
 #include <stdexcept>
 #include <string>
@@ -34,6 +37,71 @@ struct fragment_t
     static constexpr const char* name{"Fragment"};
 };
 
+/// Tag to create a shader or a program without waiting for the
+/// compilation or the link. The status is checked later by `check()`,
+/// so the driver can compile many shaders in parallel.
+struct deferred_t {};
+constexpr deferred_t deferred{};
+
+namespace detail {
+
+/// Return true if the driver of the current context compiles and
+/// links in background threads (GL_KHR_parallel_shader_compile or
+/// GL_ARB_parallel_shader_compile). The answer is cached by the state
+/// cache of the context.
+inline bool parallel_shader_compile()
+{ return state().parallel_shader_compile(); }
+
+/// Name of the type of a shader used in the error messages
+inline const char* shader_name(GLenum type)
+{
+    switch(type)
+    {
+    case GL_VERTEX_SHADER: return "Vertex";
+    case GL_GEOMETRY_SHADER: return "Geometry";
+    case GL_FRAGMENT_SHADER: return "Fragment";
+    }
+    return "Unknown";
+}
+
+/// /throw std::runtime_error if the shader `id` has a compilation error
+inline void check_shader(GLuint id, const char* name)
+{
+    GLint compiled;
+    glGetShaderiv(id, GL_COMPILE_STATUS, &compiled);
+    if(!compiled)
+    {
+        GLint length;
+        glGetShaderiv(id, GL_INFO_LOG_LENGTH, &length);
+        std::vector<char> log(length + 1);
+        glGetShaderInfoLog(id, length, &length, log.data());
+        throw std::runtime_error(std::string(name)
+                                 + " shader(id#"
+                                 + std::to_string(id) + ") "
+                                 + "compile error "
+                                 + std::string(log.data()));
+    }
+}
+
+/// Create a shader object and start the compilation of `src`
+inline GLuint compile_shader(GLenum type, const std::string& src)
+{
+    auto id = glCreateShader(type);
+    /// Section 2.11.1 - CreateShader()
+    /// "If an error occurs, zero will be returned"
+    assert(id);
+
+    /// Get a null-terminated array of the source code. It
+    /// permits the last argument to glShaderSource, a NULL
+    /// pointer.
+    auto csrc = src.c_str();
+    glShaderSource(id, 1, &csrc, NULL);
+    glCompileShader(id);
+    return id;
+}
+
+}
+
 /// Abstraction to Shader Objects
 /// (Section 2.11.1 Shader Object at OpenGL 3.3 Core Profile)
 ///
@@ -52,35 +120,15 @@ public:
     /// /throw std::runtime_error if a compilation error occurs
     ///
     shader(std::string src)
-        : _id(glCreateShader(Type::glType))
+        : shader(std::move(src), deferred)
+    { check(); }
+
+    /// Create a shader object and start the compilation without
+    /// waiting for it. check() must be called before using the shader.
+    shader(std::string src, deferred_t)
+        : _id(detail::compile_shader(Type::glType, src))
         , _src(std::move(src))
-    {
-        /// Section 2.11.1 - CreateShader()
-        /// "If an error occurs, zero will be returned"
-        assert(_id);
-
-        /// Get a null-terminated array of the source code. It
-        /// permits the last argument to glShaderSource, a NULL
-        /// pointer.
-        auto csrc = _src.c_str();
-        glShaderSource(_id, 1, &csrc, NULL);
-        
-        glCompileShader(_id);
-        GLint compiled;
-        glGetShaderiv(_id, GL_COMPILE_STATUS, &compiled);
-        if(!compiled)
-        {
-            GLint length;
-            glGetShaderiv(_id, GL_INFO_LOG_LENGTH, &length);
-            std::vector<char> log(length);
-            glGetShaderInfoLog(_id, length, &length, log.data());
-            throw std::runtime_error(std::string(Type::name)
-                                     + " shader(id#"
-                                     + std::to_string(_id) + ") "
-                                     + "compile error "
-                                     + std::string(log.data()));
-        }        
-    }
+    {}
 
     /// Mark the shader to be deleted when it's not attached to any
     /// program object
@@ -108,7 +156,25 @@ public:
 
     /// Return the source code
     const std::string& src() const noexcept
-    { return _src; }    
+    { return _src; }
+
+    /// Return true if the compilation has finished, it never blocks
+    /// (GL_COMPLETION_STATUS_KHR). Without parallel compilation it's
+    /// always true.
+    bool ready() const
+    {
+        GLint done{GL_TRUE};
+        if(detail::parallel_shader_compile())
+            glGetShaderiv(_id, GL_COMPLETION_STATUS_KHR, &done);
+        return done == GL_TRUE;
+    }
+
+    /// Wait for the compilation
+    ///
+    /// /throw std::runtime_error if a compilation error occurs
+    ///
+    void check() const
+    { detail::check_shader(_id, Type::name); }
 private:
     // Shader object's name
     GLuint _id{0};
@@ -120,5 +186,18 @@ private:
 using vertex_shader = shader<vertex_t>;
 using geometry_shader = shader<geometry_t>;
 using fragment_shader = shader<fragment_t>;
+
+/// Source code of a shader of type Type(vertex_t, geometry_t or
+/// fragment_t)
+template<typename Type>
+struct shader_source
+{
+    using type = Type;
+    std::string code;
+};
+
+using vertex_source = shader_source<vertex_t>;
+using geometry_source = shader_source<geometry_t>;
+using fragment_source = shader_source<fragment_t>;
     
 } 
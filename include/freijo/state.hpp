@@ -0,0 +1,354 @@
+
+// Copyright Ricardo Calheiros de Miranda Cosme 2017.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "freijo/extension.hpp"
+
+#include <array>
+#include <cstddef>
+#include <unordered_map>
+
+namespace freijo {
+
+/// Shadow of the bindings of an OpenGL context
+///
+/// It remembers the buffer bound to each target, the bound vertex
+/// array and the program in use, so glBindBuffer, glBindVertexArray
+/// and glUseProgram are only issued when the binding really
+/// changes. The ELEMENT_ARRAY_BUFFER binding is part of the vertex
+/// array state (Section 2.10 at OpenGL 3.3 Core Profile), so it's
+/// remembered for each vertex array.
+///
+/// A binding starts unknown and it's queried(glGetIntegerv) only if
+/// someone needs to restore it. The cache must be invalidated if the
+/// bindings are changed without it, e.g. by raw calls to glBindBuffer.
+/// A target unknown to the cache(e.g. GL_DISPATCH_INDIRECT_BUFFER) is
+/// bound on every call.
+///
+class state_cache
+{
+public:
+    struct statistics
+    {
+        /// Number of calls issued to the driver
+        std::size_t issued{0};
+
+        /// Number of calls elided because they wouldn't change the state
+        std::size_t elided{0};
+    };
+
+    state_cache()
+    { invalidate(); }
+
+    state_cache(const state_cache&) = delete;
+    state_cache& operator=(const state_cache&) = delete;
+
+    /// glBindBuffer(target, id) if `id` isn't bound to `target`
+    void bind_buffer(GLenum target, GLuint id)
+    {
+        auto& bound = slot(target);
+        if(bound == id)
+        {
+            ++_stats.elided;
+            return;
+        }
+        glBindBuffer(target, id);
+        ++_stats.issued;
+        bound = id;
+    }
+
+    /// glBindBufferBase(target, index, id)
+    ///
+    /// The indexed bindings aren't cached, but the call also binds
+    /// `id` to the generic binding of `target`.
+    void bind_buffer_base(GLenum target, GLuint index, GLuint id)
+    {
+        glBindBufferBase(target, index, id);
+        ++_stats.issued;
+        slot(target) = id;
+    }
+
+    /// glBindBufferRange(target, index, id, offset, size)
+    ///
+    /// Like bind_buffer_base() the generic binding of `target` is
+    /// changed to `id`.
+    void bind_buffer_range(GLenum target, GLuint index, GLuint id,
+                           GLintptr offset, GLsizeiptr size)
+    {
+        glBindBufferRange(target, index, id, offset, size);
+        ++_stats.issued;
+        slot(target) = id;
+    }
+
+    /// Return the buffer bound to `target`
+    GLuint buffer(GLenum target)
+    {
+        auto& bound = slot(target);
+        if(bound == unknown)
+            bound = query(binding(target));
+        return bound;
+    }
+
+    /// glBindVertexArray(id) if `id` isn't bound
+    void bind_vertex_array(GLuint id)
+    {
+        if(_vertex_array == id)
+        {
+            ++_stats.elided;
+            return;
+        }
+        glBindVertexArray(id);
+        ++_stats.issued;
+        _vertex_array = id;
+    }
+
+    /// Return the bound vertex array
+    GLuint vertex_array()
+    {
+        if(_vertex_array == unknown)
+            _vertex_array = query(GL_VERTEX_ARRAY_BINDING);
+        return _vertex_array;
+    }
+
+    /// glUseProgram(id) if `id` isn't in use
+    void use_program(GLuint id)
+    {
+        if(_program == id)
+        {
+            ++_stats.elided;
+            return;
+        }
+        glUseProgram(id);
+        ++_stats.issued;
+        _program = id;
+    }
+
+    /// Return the program in use
+    GLuint program()
+    {
+        if(_program == unknown)
+            _program = query(GL_CURRENT_PROGRAM);
+        return _program;
+    }
+
+    /// Must be called after glVertexArrayElementBuffer(vao, id)
+    void element_buffer_attached(GLuint vao, GLuint id)
+    { _elements[vao] = id; }
+
+    /// Must be called after glDeleteBuffers(1, &id)
+    ///
+    /// Section 2.9 - DeleteBuffers()
+    /// "If a buffer object that is currently bound is deleted, the
+    /// binding is effectively reverted to zero"
+    void buffer_deleted(GLuint id)
+    {
+        if(!id) return;
+        for(auto& bound : _buffers)
+            if(bound == id) bound = 0;
+        // The name can be reused, so the non-current vertex arrays
+        // that still reference it become unknown.
+        for(auto& e : _elements)
+            if(e.second == id)
+                e.second = e.first == _vertex_array ? 0u : GLuint{unknown};
+    }
+
+    /// Must be called after glDeleteVertexArrays(1, &id)
+    void vertex_array_deleted(GLuint id)
+    {
+        if(!id) return;
+        _elements.erase(id);
+        if(_vertex_array == id) _vertex_array = 0;
+    }
+
+    /// Must be called instead of glDeleteProgram(id). The program is
+    /// released from the context if it's in use.
+    void delete_program(GLuint id)
+    {
+        if(!id) return;
+        if(_program == id) use_program(0);
+        glDeleteProgram(id);
+    }
+
+    /// Forget all the bindings
+    void invalidate()
+    {
+        _buffers.fill(unknown);
+        _elements.clear();
+        _vertex_array = unknown;
+        _program = unknown;
+    }
+
+    /// Version of the context as major * 10 + minor, e.g. 43 for
+    /// OpenGL 4.3. It's queried(glGetIntegerv) on the first call and
+    /// it isn't forgotten by invalidate(), a cache belongs to a single
+    /// context.
+    int version()
+    {
+        if(_version == 0)
+        {
+            GLint major{0}, minor{0};
+            glGetIntegerv(GL_MAJOR_VERSION, &major);
+            glGetIntegerv(GL_MINOR_VERSION, &minor);
+            _version = major * 10 + minor;
+        }
+        return _version;
+    }
+
+    /// Return true if the context compiles and links in background
+    /// threads(GL_KHR_parallel_shader_compile or
+    /// GL_ARB_parallel_shader_compile). It's queried on the first call,
+    /// like version().
+    bool parallel_shader_compile()
+    {
+        if(_parallel_shader_compile < 0)
+            _parallel_shader_compile =
+                has_extension("GL_KHR_parallel_shader_compile")
+                || has_extension("GL_ARB_parallel_shader_compile");
+        return _parallel_shader_compile > 0;
+    }
+
+    const statistics& stats() const noexcept
+    { return _stats; }
+
+    void reset_stats() noexcept
+    { _stats = statistics{}; }
+private:
+    enum : GLuint { unknown = static_cast<GLuint>(-1) };
+
+    // Buffer targets besides ELEMENT_ARRAY_BUFFER
+    std::array<GLuint, 12> _buffers;
+
+    // Binding of a target that isn't cached. It's unknown on every
+    // call, so the binds are never elided.
+    GLuint _untracked;
+
+    // ELEMENT_ARRAY_BUFFER binding of each vertex array
+    std::unordered_map<GLuint, GLuint> _elements;
+
+    GLuint _vertex_array;
+    GLuint _program;
+    int _version{0};
+    // -1 while unknown
+    int _parallel_shader_compile{-1};
+    statistics _stats;
+
+    GLuint& slot(GLenum target)
+    {
+        if(target == GL_ELEMENT_ARRAY_BUFFER)
+        {
+            auto vao = vertex_array();
+            auto it = _elements.find(vao);
+            if(it != _elements.end()) return it->second;
+            return _elements.emplace(vao, GLuint{unknown}).first->second;
+        }
+        auto i = index(target);
+        if(i == untracked)
+        {
+            _untracked = unknown;
+            return _untracked;
+        }
+        return _buffers[i];
+    }
+
+    enum : std::size_t { untracked = static_cast<std::size_t>(-1) };
+
+    // Slot of `target` in _buffers, or untracked if the target isn't
+    // cached
+    static std::size_t index(GLenum target)
+    {
+        switch(target)
+        {
+        case GL_ARRAY_BUFFER: return 0;
+        case GL_COPY_READ_BUFFER: return 1;
+        case GL_COPY_WRITE_BUFFER: return 2;
+        case GL_PIXEL_PACK_BUFFER: return 3;
+        case GL_PIXEL_UNPACK_BUFFER: return 4;
+        case GL_TEXTURE_BUFFER: return 5;
+        case GL_TRANSFORM_FEEDBACK_BUFFER: return 6;
+        case GL_UNIFORM_BUFFER: return 7;
+#ifdef GL_DRAW_INDIRECT_BUFFER
+        case GL_DRAW_INDIRECT_BUFFER: return 8;
+#endif
+#ifdef GL_ATOMIC_COUNTER_BUFFER
+        case GL_ATOMIC_COUNTER_BUFFER: return 9;
+#endif
+#ifdef GL_SHADER_STORAGE_BUFFER
+        case GL_SHADER_STORAGE_BUFFER: return 10;
+#endif
+#ifdef GL_QUERY_BUFFER
+        case GL_QUERY_BUFFER: return 11;
+#endif
+        }
+        return untracked;
+    }
+
+    static GLenum binding(GLenum target)
+    {
+        switch(target)
+        {
+        case GL_ARRAY_BUFFER: return GL_ARRAY_BUFFER_BINDING;
+        case GL_ELEMENT_ARRAY_BUFFER: return GL_ELEMENT_ARRAY_BUFFER_BINDING;
+        case GL_PIXEL_PACK_BUFFER: return GL_PIXEL_PACK_BUFFER_BINDING;
+        case GL_PIXEL_UNPACK_BUFFER: return GL_PIXEL_UNPACK_BUFFER_BINDING;
+        case GL_TRANSFORM_FEEDBACK_BUFFER:
+            return GL_TRANSFORM_FEEDBACK_BUFFER_BINDING;
+        case GL_UNIFORM_BUFFER: return GL_UNIFORM_BUFFER_BINDING;
+#ifdef GL_DRAW_INDIRECT_BUFFER_BINDING
+        case GL_DRAW_INDIRECT_BUFFER: return GL_DRAW_INDIRECT_BUFFER_BINDING;
+#endif
+#ifdef GL_ATOMIC_COUNTER_BUFFER_BINDING
+        case GL_ATOMIC_COUNTER_BUFFER:
+            return GL_ATOMIC_COUNTER_BUFFER_BINDING;
+#endif
+#ifdef GL_SHADER_STORAGE_BUFFER_BINDING
+        case GL_SHADER_STORAGE_BUFFER:
+            return GL_SHADER_STORAGE_BUFFER_BINDING;
+#endif
+#ifdef GL_QUERY_BUFFER_BINDING
+        case GL_QUERY_BUFFER: return GL_QUERY_BUFFER_BINDING;
+#endif
+#ifdef GL_DISPATCH_INDIRECT_BUFFER_BINDING
+        case GL_DISPATCH_INDIRECT_BUFFER:
+            return GL_DISPATCH_INDIRECT_BUFFER_BINDING;
+#endif
+        }
+        // COPY_READ_BUFFER, COPY_WRITE_BUFFER and TEXTURE_BUFFER are
+        // also the names of their bindings.
+        return target;
+    }
+
+    static GLuint query(GLenum pname)
+    {
+        GLint id{0};
+        glGetIntegerv(pname, &id);
+        return static_cast<GLuint>(id);
+    }
+};
+
+namespace detail {
+
+inline state_cache*& current_state()
+{
+    static thread_local state_cache default_state;
+    static thread_local state_cache* current{&default_state};
+    return current;
+}
+
+}
+
+/// Return the state cache of the context that is current in the
+/// calling thread.
+inline state_cache& state()
+{ return *detail::current_state(); }
+
+/// Make `s` the state cache of the calling thread. It must be called
+/// when a different OpenGL context is made current in the thread
+/// (e.g. glfwMakeContextCurrent), one cache per context.
+inline void make_current(state_cache& s)
+{ detail::current_state() = &s; }
+
+}
@@ -0,0 +1,192 @@
+
+// Copyright Ricardo Calheiros de Miranda Cosme 2017.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+#include <glm/glm.hpp>
+#include <glm/detail/precision.hpp>
+
+namespace freijo {
+
+// Compile-time validation of the std140 layout
+// (Section 2.11.4 Uniform Variables - Standard Uniform Block Layout at
+// OpenGL 3.3 Core Profile)
+//
+// A C++ type can be copied as-is to a uniform block only if the offset
+// of each member is the offset given by the std140 rules. The members
+// of a block are described by specializing UniformLayout, in the same
+// way of VertexLayout:
+//
+// struct Frame { glm::mat4 view; glm::vec3 eye; float time; };
+//
+// namespace freijo {
+// template<>
+// struct UniformLayout<Frame>
+//     : std140_layout<Frame,
+//                     FREIJO_STD140_MEMBER(Frame, view),
+//                     FREIJO_STD140_MEMBER(Frame, eye),
+//                     FREIJO_STD140_MEMBER(Frame, time)> {};
+// }
+
+namespace detail {
+
+constexpr std::size_t align_up(std::size_t offset, std::size_t alignment)
+{ return (offset + alignment - 1) / alignment * alignment; }
+
+}
+
+// Base alignment and size of a type in the std140 layout. Only the
+// types that have the same size in C++ and in std140 are defined, so
+// a vec3 in an array or a mat3 fails to compile.
+template<typename T, typename = void>
+struct std140_traits;
+
+#define std140_traits_SCALAR(T) \
+template<> \
+struct std140_traits<T> \
+{ \
+    static const std::size_t alignment{sizeof(T)}; \
+    static const std::size_t size{sizeof(T)}; \
+};
+
+std140_traits_SCALAR(GLfloat)
+std140_traits_SCALAR(GLint)
+std140_traits_SCALAR(GLuint)
+std140_traits_SCALAR(GLdouble)
+
+// vec2 has the alignment 2N, vec3 and vec4 have the alignment 4N.
+#define std140_traits_GLM_TVEC(TVEC, SIZE, ALIGNMENT) \
+template<typename T, glm::precision P> \
+struct std140_traits<glm::TVEC<T, P>> \
+{ \
+    static const std::size_t alignment{ALIGNMENT * sizeof(T)}; \
+    static const std::size_t size{SIZE * sizeof(T)}; \
+};
+
+std140_traits_GLM_TVEC(tvec2, 2, 2)
+std140_traits_GLM_TVEC(tvec3, 3, 4)
+std140_traits_GLM_TVEC(tvec4, 4, 4)
+
+// A matrix is an array of column vectors, each one aligned to a
+// vec4. Only the matrices with 4 rows match the C++ layout.
+#define std140_traits_GLM_TMAT(TMAT, COLUMNS) \
+template<typename T, glm::precision P> \
+struct std140_traits<glm::TMAT<T, P>> \
+{ \
+    static const std::size_t alignment{4 * sizeof(T)}; \
+    static const std::size_t size{COLUMNS * 4 * sizeof(T)}; \
+};
+
+std140_traits_GLM_TMAT(tmat2x4, 2)
+std140_traits_GLM_TMAT(tmat3x4, 3)
+std140_traits_GLM_TMAT(tmat4x4, 4)
+
+// The stride of an array is rounded up to the alignment of a vec4.
+template<typename T, std::size_t N>
+struct std140_traits<T[N]>
+{
+    static_assert(std140_traits<T>::size % 16 == 0,
+                  "The std140 stride of an array is a multiple of 16 bytes, "
+                  "pad the element type");
+    static const std::size_t alignment{
+        detail::align_up(std140_traits<T>::alignment, 16)};
+    static const std::size_t size{N * std140_traits<T>::size};
+};
+
+// Member of a uniform block: type of the member(T) and position of
+// the member in the block(Offset).
+template<typename T, std::size_t Offset>
+struct std140_member
+{
+    using type = T;
+    static const std::size_t offset = Offset;
+};
+
+// Member defined by the member MEMBER of BLOCK.
+#define FREIJO_STD140_MEMBER(BLOCK, MEMBER) \
+    freijo::std140_member<decltype(BLOCK::MEMBER), offsetof(BLOCK, MEMBER)>
+
+namespace detail {
+
+template<std::size_t End, typename... Members>
+struct std140_offsets : std::true_type
+{ static const std::size_t end = End; };
+
+template<std::size_t End, typename M, typename... Members>
+struct std140_offsets<End, M, Members...>
+    : std::integral_constant<bool,
+        M::offset == align_up(End, std140_traits<typename M::type>::alignment)
+        && std140_offsets<M::offset + std140_traits<typename M::type>::size,
+                          Members...>::value>
+{
+    static const std::size_t end = std140_offsets<
+        M::offset + std140_traits<typename M::type>::size,
+        Members...>::end;
+};
+
+}
+
+// Layout of a uniform block. The members must be declared in the
+// order of the members of Block.
+template<typename Block, typename... Members>
+struct std140_layout
+{
+    static_assert(std::is_standard_layout<Block>::value,
+                  "The block must be a standard-layout type");
+    static_assert(detail::std140_offsets<0, Members...>::value,
+                  "The offset of a member isn't the std140 offset, "
+                  "add padding before it");
+    static_assert(sizeof(Block) == detail::align_up(
+                      detail::std140_offsets<0, Members...>::end, 16),
+                  "The size of the block must be the std140 size rounded "
+                  "up to 16 bytes, check the padding at the end");
+
+    using block = Block;
+};
+
+// Traits for uniform blocks. It must be specialized inheriting from
+// std140_layout to validate the members of a block.
+template<typename T>
+struct UniformLayout {};
+
+namespace detail {
+
+template<typename T, typename = void>
+struct has_uniform_layout : std::false_type {};
+
+template<typename T>
+struct has_uniform_layout<
+    T, typename std::conditional<
+           true, void, typename UniformLayout<T>::block>::type>
+    : std::true_type {};
+
+}
+
+// A nested block is aligned to a vec4.
+template<typename T>
+struct std140_traits<
+    T, typename std::enable_if<detail::has_uniform_layout<T>::value>::type>
+{
+    static const std::size_t alignment{16};
+    static const std::size_t size{sizeof(T)};
+};
+
+// Return true if T can be copied as-is to a uniform block: a glm type
+// with the same layout in std140 or a block with a valid UniformLayout.
+template<typename T, typename = void>
+struct is_std140 : std::false_type {};
+
+template<typename T>
+struct is_std140<
+    T, typename std::conditional<
+           true, void, decltype(std140_traits<T>::size)>::type>
+    : std::integral_constant<bool,
+        std140_traits<T>::size % 16 == 0
+        && std::is_trivially_copyable<T>::value> {};
+
+}
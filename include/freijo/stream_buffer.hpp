@@ -0,0 +1,191 @@
+
+// Copyright Ricardo Calheiros de Miranda Cosme 2017.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "freijo/buffer.hpp"
+#include "freijo/fence.hpp"
+#include "freijo/state.hpp"
+
+#include <cassert>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace freijo {
+
+/// Ring of regions inside a persistent mapped buffer to stream data
+/// that is rewritten every frame.
+///
+/// The storage is allocated once with glBufferStorage (OpenGL 4.4 or
+/// ARB_buffer_storage) and mapped with GL_MAP_PERSISTENT_BIT |
+/// GL_MAP_COHERENT_BIT, so there are no calls to glBufferData,
+/// glBufferSubData or glMapBuffer while streaming. Each region is
+/// guarded by a fence: `next()` hands out the next region of the
+/// ring and `commit()` marks the end of the commands that read it. The
+/// CPU only waits if it wraps around the ring before the GPU
+/// finishes the oldest region, so `regions` should be at least the
+/// number of frames in flight plus one.
+///
+/// Example:
+///
+///   freijo::stream_buffer<glm::vec3, freijo::ArrayBuffer<glm::vec3>>
+///       stream(1024);
+///   vao.attach(0, stream);
+///   ...
+///   auto r = stream.next();
+///   std::copy(vertices.begin(), vertices.end(), r.data);
+///   glDrawArrays(GL_TRIANGLES, r.first, vertices.size());
+///   stream.commit();
+///
+/// /tparam ValueType Type of the element stored in the buffer.
+/// /tparam Target Purpose of the buffer (see buffer).
+///
+/// Model the concept Movable.
+///
+template<typename ValueType, typename Target>
+class stream_buffer
+{
+public:
+    using value_type = ValueType;
+    using target = Target;
+
+    /// Region of the ring that can be written by the CPU.
+    struct region
+    {
+        /// Pointer to the first element of the region
+        value_type* data;
+
+        /// Index of the first element of the region in the buffer
+        std::size_t first;
+
+        /// Number of elements of the region
+        std::size_t size;
+
+        /// Offset in bytes of the region in the buffer
+        std::size_t offset() const noexcept
+        { return first * sizeof(value_type); }
+    };
+
+    /// poscondition: id() == 0
+    stream_buffer() = default;
+
+    /// Allocate an immutable storage of `regions` * `count` elements
+    /// and map it persistently.
+    ///
+    /// /param count Number of elements of each region.
+    /// /param regions Number of regions of the ring.
+    ///
+    explicit stream_buffer(std::size_t count, std::size_t regions = 3)
+        : _count(count)
+        , _fences(regions)
+    {
+        assert(count > 0 && regions > 0);
+        const GLbitfield flags = GL_MAP_WRITE_BIT
+            | GL_MAP_PERSISTENT_BIT
+            | GL_MAP_COHERENT_BIT;
+#ifdef FREIJO_DSA
+        glCreateBuffers(1, &_id);
+        glNamedBufferStorage(_id, area(), nullptr, flags);
+        _data = reinterpret_cast<value_type*>
+            (glMapNamedBufferRange(_id, 0, area(), flags));
+#else
+        glGenBuffers(1, &_id);
+        scoped_target_buffer_bind bbg(target::target, _id);
+        glBufferStorage(target::target, area(), nullptr, flags);
+        _data = reinterpret_cast<value_type*>
+            (glMapBufferRange(target::target, 0, area(), flags));
+#endif
+    }
+
+    /// Section 2.9 - DeleteBuffers()
+    /// "If a buffer object is deleted while it is mapped, it is
+    /// implicitly unmapped"
+    ~stream_buffer()
+    {
+        glDeleteBuffers(1, &_id);
+        state().buffer_deleted(_id);
+    }
+
+    stream_buffer(const stream_buffer&) = delete;
+    stream_buffer& operator=(const stream_buffer&) = delete;
+
+    stream_buffer(stream_buffer&& rhs) noexcept
+    { swap(*this, rhs); }
+
+    stream_buffer& operator=(stream_buffer&& rhs) noexcept
+    {
+        swap(*this, rhs);
+        return *this;
+    }
+
+    friend void swap(stream_buffer& a, stream_buffer& b) noexcept
+    {
+        std::swap(a._id, b._id);
+        std::swap(a._data, b._data);
+        std::swap(a._count, b._count);
+        std::swap(a._current, b._current);
+        std::swap(a._stalls, b._stalls);
+        std::swap(a._fences, b._fences);
+    }
+
+    /// Advance to the next region of the ring.
+    ///
+    /// It blocks only if the GPU is still reading the region, which
+    /// is counted by `stalls()`.
+    ///
+    /// precondition: id() != 0
+    ///
+    region next()
+    {
+        assert(_id);
+        _current = (_current + 1) % _fences.size();
+        auto& f = _fences[_current];
+        if(!f.signaled())
+        {
+            ++_stalls;
+            f.wait();
+        }
+        f.reset();
+        auto first = _current * _count;
+        return {_data + first, first, _count};
+    }
+
+    /// Insert a fence that guards the current region. It must be
+    /// called after the commands that read the region.
+    void commit()
+    { _fences[_current].set(); }
+
+    void bind() const
+    { state().bind_buffer(target::target, _id); }
+
+    void unbind() const
+    { state().bind_buffer(target::target, 0); }
+
+    /// Number of elements of each region.
+    std::size_t size() const noexcept { return _count; }
+
+    /// Number of regions of the ring.
+    std::size_t regions() const noexcept { return _fences.size(); }
+
+    /// Number of times that next() waited for the GPU.
+    std::size_t stalls() const noexcept { return _stalls; }
+
+    /// Return the buffer's name
+    GLuint id() const noexcept { return _id; }
+private:
+    GLuint _id{0};
+    value_type* _data{nullptr};
+    std::size_t _count{0};
+    std::size_t _current{0};
+    std::size_t _stalls{0};
+    std::vector<fence> _fences;
+
+    std::size_t area() const noexcept
+    { return sizeof(value_type) * _count * _fences.size(); }
+};
+
+}
@@ -0,0 +1,594 @@
+
+// Copyright Ricardo Calheiros de Miranda Cosme 2017.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "freijo/buffer.hpp"
+#include "freijo/state.hpp"
+#include "freijo/stream_buffer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace freijo {
+
+/// Traits of the format of a pixel type: the format of the storage of
+/// the texture(internal_format), and the format and type of the
+/// pixels in client memory or in a pixel unpack buffer(format and
+/// type) (Section 8.4 Pixel Rectangles and 8.5 Texture Image
+/// Specification at OpenGL 4.5 Core Profile).
+///
+/// It can be specialized to other types, e.g.
+///
+///   template<>
+///   struct PixelTraits<srgb_pixel>
+///   {
+///       static const GLenum internal_format{GL_SRGB8_ALPHA8};
+///       static const GLenum format{GL_RGBA};
+///       static const GLenum type{GL_UNSIGNED_BYTE};
+///   };
+template<typename T>
+struct PixelTraits;
+
+#define PixelTraits_GLM_TVEC(TVEC, COMPONENT, INTERNAL_FORMAT, FORMAT) \
+template<glm::precision P> \
+struct PixelTraits<glm::TVEC<COMPONENT, P>> \
+{\
+    static const GLenum internal_format{INTERNAL_FORMAT}; \
+    static const GLenum format{FORMAT}; \
+    static const GLenum type{GLTypeTraits<COMPONENT>::type}; \
+};
+
+#define PixelTraits_SCALAR(COMPONENT, INTERNAL_FORMAT) \
+template<> \
+struct PixelTraits<COMPONENT> \
+{\
+    static const GLenum internal_format{INTERNAL_FORMAT}; \
+    static const GLenum format{GL_RED}; \
+    static const GLenum type{GLTypeTraits<COMPONENT>::type}; \
+};
+
+//8-bit components normalized to [0, 1]
+PixelTraits_SCALAR(GLubyte, GL_R8)
+PixelTraits_GLM_TVEC(tvec1, GLubyte, GL_R8, GL_RED)
+PixelTraits_GLM_TVEC(tvec2, GLubyte, GL_RG8, GL_RG)
+PixelTraits_GLM_TVEC(tvec3, GLubyte, GL_RGB8, GL_RGB)
+PixelTraits_GLM_TVEC(tvec4, GLubyte, GL_RGBA8, GL_RGBA)
+
+//16-bit components normalized to [0, 1]
+PixelTraits_SCALAR(GLushort, GL_R16)
+PixelTraits_GLM_TVEC(tvec1, GLushort, GL_R16, GL_RED)
+PixelTraits_GLM_TVEC(tvec2, GLushort, GL_RG16, GL_RG)
+PixelTraits_GLM_TVEC(tvec3, GLushort, GL_RGB16, GL_RGB)
+PixelTraits_GLM_TVEC(tvec4, GLushort, GL_RGBA16, GL_RGBA)
+
+//32-bit floating-point components
+PixelTraits_SCALAR(GLfloat, GL_R32F)
+PixelTraits_GLM_TVEC(tvec1, GLfloat, GL_R32F, GL_RED)
+PixelTraits_GLM_TVEC(tvec2, GLfloat, GL_RG32F, GL_RG)
+PixelTraits_GLM_TVEC(tvec3, GLfloat, GL_RGB32F, GL_RGB)
+PixelTraits_GLM_TVEC(tvec4, GLfloat, GL_RGBA32F, GL_RGBA)
+
+#undef PixelTraits_GLM_TVEC
+#undef PixelTraits_SCALAR
+
+template<typename Pixel>
+class texture_stream;
+
+namespace detail {
+
+/// Number of levels of a full mipmap chain of a `width` x `height`
+/// image
+inline GLsizei mip_levels(GLsizei width, GLsizei height)
+{
+    GLsizei levels{1};
+    for(auto n = std::max(width, height); n > 1; n /= 2) ++levels;
+    return levels;
+}
+
+// RAII to glBindTexture on the active texture unit. Restores the
+// texture that was bound to the target.
+class scoped_texture_bind
+{
+public:
+    scoped_texture_bind(GLenum target, GLuint id)
+        : _target(target)
+    {
+        GLint previous{0};
+        glGetIntegerv(target == GL_TEXTURE_2D_ARRAY
+                      ? GL_TEXTURE_BINDING_2D_ARRAY
+                      : GL_TEXTURE_BINDING_2D, &previous);
+        _previous = previous;
+        glBindTexture(_target, id);
+    }
+
+    ~scoped_texture_bind() { glBindTexture(_target, _previous); }
+
+    scoped_texture_bind(const scoped_texture_bind&) = delete;
+    scoped_texture_bind& operator=(const scoped_texture_bind&) = delete;
+private:
+    GLenum _target;
+    GLuint _previous;
+};
+
+// The rows of the pixels are tightly packed. GL_UNPACK_ALIGNMENT is
+// changed to 1 while a row isn't a multiple of the current alignment,
+// e.g. the RGB8 rows of an odd width, and restored after.
+class scoped_unpack_alignment
+{
+public:
+    explicit scoped_unpack_alignment(std::size_t row_bytes)
+    {
+        GLint alignment{4};
+        glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+        _previous = alignment;
+        _changed = row_bytes % _previous != 0;
+        if(_changed) glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    }
+
+    ~scoped_unpack_alignment()
+    { if(_changed) glPixelStorei(GL_UNPACK_ALIGNMENT, _previous); }
+
+    scoped_unpack_alignment(const scoped_unpack_alignment&) = delete;
+    scoped_unpack_alignment& operator=(const scoped_unpack_alignment&) = delete;
+private:
+    GLint _previous;
+    bool _changed;
+};
+
+// Name, storage levels and parameters of a texture of `Target`
+template<GLenum Target>
+class texture_base
+{
+public:
+    static const GLenum target = Target;
+
+    texture_base() = default;
+
+    ~texture_base()
+    { glDeleteTextures(1, &_id); }
+
+    texture_base(const texture_base&) = delete;
+    texture_base& operator=(const texture_base&) = delete;
+
+    texture_base(texture_base&& rhs) noexcept
+    {
+        std::swap(_id, rhs._id);
+        std::swap(_levels, rhs._levels);
+    }
+
+    texture_base& operator=(texture_base&& rhs) noexcept
+    {
+        std::swap(_id, rhs._id);
+        std::swap(_levels, rhs._levels);
+        return *this;
+    }
+
+    /// Bind the texture to the texture unit `unit`. With FREIJO_DSA
+    /// the active texture unit isn't changed, otherwise it's `unit`.
+    void bind(GLuint unit) const
+    {
+#ifdef FREIJO_DSA
+        glBindTextureUnit(unit, _id);
+#else
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(Target, _id);
+#endif
+    }
+
+    /// Compute the levels 1 to levels() - 1 from the level 0
+    void generate_mipmaps()
+    {
+#ifdef FREIJO_DSA
+        glGenerateTextureMipmap(_id);
+#else
+        scoped_texture_bind b(Target, _id);
+        glGenerateMipmap(Target);
+#endif
+    }
+
+    /// glTexParameteri(target, pname, value)
+    void parameter(GLenum pname, GLint value)
+    {
+#ifdef FREIJO_DSA
+        glTextureParameteri(_id, pname, value);
+#else
+        scoped_texture_bind b(Target, _id);
+        glTexParameteri(Target, pname, value);
+#endif
+    }
+
+    void filter(GLint min, GLint mag)
+    {
+        parameter(GL_TEXTURE_MIN_FILTER, min);
+        parameter(GL_TEXTURE_MAG_FILTER, mag);
+    }
+
+    void wrap(GLint s, GLint t)
+    {
+        parameter(GL_TEXTURE_WRAP_S, s);
+        parameter(GL_TEXTURE_WRAP_T, t);
+    }
+
+    /// Number of mipmap levels of the storage
+    GLsizei levels() const noexcept { return _levels; }
+
+    /// Return the texture's name
+    GLuint id() const noexcept { return _id; }
+protected:
+    GLuint _id{0};
+    GLsizei _levels{0};
+
+    void create(GLsizei levels)
+    {
+#ifdef FREIJO_DSA
+        glCreateTextures(Target, 1, &_id);
+#else
+        glGenTextures(1, &_id);
+#endif
+        _levels = levels;
+    }
+};
+
+}
+
+/// 2D texture with immutable storage(glTexStorage2D, OpenGL 4.2 or
+/// ARB_texture_storage)
+///
+/// The storage of all the levels is allocated at construction and it
+/// can't be reallocated, only its contents are updated
+/// (glTexSubImage2D). The format comes from PixelTraits<Pixel>.
+///
+/// Example:
+///
+///   freijo::texture_2d<glm::u8vec4> albedo(width, height, pixels.data());
+///   albedo.filter(GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
+///   albedo.bind(0); //layout(binding = 0) uniform sampler2D
+///
+/// Streamed updates go through a texture_stream.
+///
+/// If FREIJO_DSA isn't defined the texture is bound to the active
+/// texture unit during the calls, and then the previous texture is
+/// bound again.
+///
+/// Model the concept Movable.
+///
+template<typename Pixel>
+class texture_2d : public detail::texture_base<GL_TEXTURE_2D>
+{
+public:
+    using pixel_type = Pixel;
+    using traits = PixelTraits<Pixel>;
+
+    /// poscondition: id() == 0
+    texture_2d() = default;
+
+    /// Allocate the storage of `levels` levels, 0 to a full mipmap
+    /// chain. The contents are undefined.
+    texture_2d(GLsizei width, GLsizei height, GLsizei levels = 0)
+        : _width(width)
+        , _height(height)
+    {
+        create(levels ? levels : detail::mip_levels(width, height));
+#ifdef FREIJO_DSA
+        glTextureStorage2D(_id, _levels, traits::internal_format, width,
+                           height);
+#else
+        detail::scoped_texture_bind b(target, _id);
+        glTexStorage2D(target, _levels, traits::internal_format, width,
+                       height);
+#endif
+    }
+
+    /// Allocate the storage and copy `width` * `height` pixels to the
+    /// level 0. The other levels are generated from it.
+    texture_2d(GLsizei width, GLsizei height, const pixel_type* pixels,
+               GLsizei levels = 0)
+        : texture_2d(width, height, levels)
+    {
+        update(pixels);
+        if(_levels > 1) generate_mipmaps();
+    }
+
+    texture_2d(texture_2d&&) = default;
+    texture_2d& operator=(texture_2d&&) = default;
+
+    /// Copy `w` * `h` pixels to the rectangle at (`x`, `y`) of `level`
+    /// from client memory. The call returns after the copy.
+    void update(const pixel_type* pixels, GLint x, GLint y, GLsizei w,
+                GLsizei h, GLint level = 0)
+    {
+        scoped_target_buffer_bind bbg(GL_PIXEL_UNPACK_BUFFER, 0);
+        sub_image(level, x, y, w, h, pixels);
+    }
+
+    /// Copy width() * height() pixels to the level 0
+    void update(const pixel_type* pixels)
+    { update(pixels, 0, 0, _width, _height); }
+
+    GLsizei width() const noexcept { return _width; }
+    GLsizei height() const noexcept { return _height; }
+private:
+    friend class texture_stream<Pixel>;
+
+    GLsizei _width{0};
+    GLsizei _height{0};
+
+    // precondition: the source of the pixels is bound to
+    //               GL_PIXEL_UNPACK_BUFFER, or 0 to client memory
+    void sub_image(GLint level, GLint x, GLint y, GLsizei w, GLsizei h,
+                   const void* pixels)
+    {
+        assert(x >= 0 && y >= 0 && x + w <= std::max(1, _width >> level)
+               && y + h <= std::max(1, _height >> level));
+        detail::scoped_unpack_alignment a(w * sizeof(pixel_type));
+#ifdef FREIJO_DSA
+        glTextureSubImage2D(_id, level, x, y, w, h, traits::format,
+                            traits::type, pixels);
+#else
+        detail::scoped_texture_bind b(target, _id);
+        glTexSubImage2D(target, level, x, y, w, h, traits::format,
+                        traits::type, pixels);
+#endif
+    }
+};
+
+/// Array of 2D textures of the same size with immutable storage
+/// (glTexStorage3D, OpenGL 4.2 or ARB_texture_storage)
+///
+/// Each layer is an image with its own mipmaps, sampled by a
+/// sampler2DArray. generate_mipmaps() computes the levels of all the
+/// layers.
+///
+/// Example:
+///
+///   freijo::texture_2d_array<glm::u8vec4> tiles(256, 256, 64);
+///   for(GLint i{0}; i < 64; ++i)
+///       tiles.update(i, images[i].data());
+///   tiles.generate_mipmaps();
+///
+/// Model the concept Movable.
+///
+template<typename Pixel>
+class texture_2d_array : public detail::texture_base<GL_TEXTURE_2D_ARRAY>
+{
+public:
+    using pixel_type = Pixel;
+    using traits = PixelTraits<Pixel>;
+
+    /// poscondition: id() == 0
+    texture_2d_array() = default;
+
+    /// Allocate the storage of `layers` images with `levels` levels,
+    /// 0 to a full mipmap chain. The contents are undefined.
+    texture_2d_array(GLsizei width, GLsizei height, GLsizei layers,
+                     GLsizei levels = 0)
+        : _width(width)
+        , _height(height)
+        , _layers(layers)
+    {
+        create(levels ? levels : detail::mip_levels(width, height));
+#ifdef FREIJO_DSA
+        glTextureStorage3D(_id, _levels, traits::internal_format, width,
+                           height, layers);
+#else
+        detail::scoped_texture_bind b(target, _id);
+        glTexStorage3D(target, _levels, traits::internal_format, width,
+                       height, layers);
+#endif
+    }
+
+    texture_2d_array(texture_2d_array&&) = default;
+    texture_2d_array& operator=(texture_2d_array&&) = default;
+
+    /// Copy `w` * `h` pixels to the rectangle at (`x`, `y`) of `level`
+    /// of `layer` from client memory. The call returns after the copy.
+    void update(GLint layer, const pixel_type* pixels, GLint x, GLint y,
+                GLsizei w, GLsizei h, GLint level = 0)
+    {
+        scoped_target_buffer_bind bbg(GL_PIXEL_UNPACK_BUFFER, 0);
+        sub_image(level, layer, x, y, w, h, pixels);
+    }
+
+    /// Copy width() * height() pixels to the level 0 of `layer`
+    void update(GLint layer, const pixel_type* pixels)
+    { update(layer, pixels, 0, 0, _width, _height); }
+
+    GLsizei width() const noexcept { return _width; }
+    GLsizei height() const noexcept { return _height; }
+    GLsizei layers() const noexcept { return _layers; }
+private:
+    friend class texture_stream<Pixel>;
+
+    GLsizei _width{0};
+    GLsizei _height{0};
+    GLsizei _layers{0};
+
+    // precondition: the source of the pixels is bound to
+    //               GL_PIXEL_UNPACK_BUFFER, or 0 to client memory
+    void sub_image(GLint level, GLint layer, GLint x, GLint y, GLsizei w,
+                   GLsizei h, const void* pixels)
+    {
+        assert(layer >= 0 && layer < _layers);
+        assert(x >= 0 && y >= 0 && x + w <= std::max(1, _width >> level)
+               && y + h <= std::max(1, _height >> level));
+        detail::scoped_unpack_alignment a(w * sizeof(pixel_type));
+#ifdef FREIJO_DSA
+        glTextureSubImage3D(_id, level, x, y, layer, w, h, 1,
+                            traits::format, traits::type, pixels);
+#else
+        detail::scoped_texture_bind b(target, _id);
+        glTexSubImage3D(target, level, x, y, layer, w, h, 1,
+                        traits::format, traits::type, pixels);
+#endif
+    }
+};
+
+/// Ring of pixel unpack buffers to stream texture updates
+///
+/// The pixels are staged in a persistent mapped stream_buffer
+/// (GL_PIXEL_UNPACK_BUFFER) and the textures are updated from it, so
+/// glTexSubImage returns at once and the transfer is done by the GPU,
+/// without a copy of the client memory by the driver. stage() hands
+/// out space in the ring to write the pixels in place, e.g. to decode
+/// an image straight into it. The CPU only waits if it wraps around
+/// the ring before the GPU reads the oldest region.
+///
+/// Each staging must be passed to update() before the next stage() or
+/// end_frame(): a stage() that wraps to the next region fences the
+/// reads issued so far, and an update of an older staging would read
+/// the pixels after the fence, while the CPU may overwrite them.
+///
+/// Example:
+///
+///   freijo::texture_stream<glm::u8vec4> stream(1024 * 1024);
+///   ...
+///   stream.begin_frame();
+///   auto s = stream.stage(w * h);
+///   decode(tile, s.data);
+///   stream.update(atlas, s, x, y, w, h);
+///   stream.end_frame();
+///
+/// /param Pixel Type of the pixel(see PixelTraits).
+///
+/// Model the concept Movable.
+///
+template<typename Pixel>
+class texture_stream
+{
+public:
+    using pixel_type = Pixel;
+    using target = PixelUnpackBuffer<Pixel>;
+
+    /// Space of the ring returned by stage()
+    struct staging
+    {
+        /// Pointer to the first pixel
+        pixel_type* data;
+
+        /// Index of the first pixel in the buffer
+        std::size_t first;
+
+        /// Number of pixels
+        std::size_t size;
+    };
+
+    /// /param capacity Number of pixels of each frame. A frame with
+    ///                 more pixels waits for the GPU to reuse the
+    ///                 next region.
+    /// /param regions Number of frames in the ring.
+    explicit texture_stream(std::size_t capacity, std::size_t regions = 3)
+        : _stream(capacity, regions)
+    {}
+
+    /// Start staging the pixels of a frame.
+    void begin_frame()
+    {
+        _region = _stream.next();
+        _used = 0;
+    }
+
+    /// Return space for `count` pixels in the ring
+    ///
+    /// precondition: count <= capacity()
+    /// precondition: the previous staging was passed to update()
+    staging stage(std::size_t count)
+    {
+        assert(count <= _stream.size());
+        assert(!_staged && "update() the previous staging first");
+        if(_used + count > _region.size)
+        {
+            _stream.commit();
+            begin_frame();
+        }
+        staging s{_region.data + _used, _region.first + _used, count};
+        _used += count;
+        _staged = true;
+        return s;
+    }
+
+    /// Update the rectangle at (`x`, `y`) of `level` of `tex` with
+    /// the staged pixels `s`.
+    ///
+    /// precondition: w * h <= s.size
+    void update(texture_2d<Pixel>& tex, const staging& s, GLint x, GLint y,
+                GLsizei w, GLsizei h, GLint level = 0)
+    {
+        assert(std::size_t(w) * h <= s.size);
+        scoped_target_buffer_bind bbg(target::target, _stream.id());
+        tex.sub_image(level, x, y, w, h, offset(s));
+        _staged = false;
+    }
+
+    /// Copy `w` * `h` pixels to the ring and update the rectangle at
+    /// (`x`, `y`) of `level` of `tex` with them.
+    void update(texture_2d<Pixel>& tex, const pixel_type* pixels, GLint x,
+                GLint y, GLsizei w, GLsizei h, GLint level = 0)
+    { update(tex, copy(pixels, std::size_t(w) * h), x, y, w, h, level); }
+
+    /// Update the rectangle at (`x`, `y`) of `level` of `layer` of
+    /// `tex` with the staged pixels `s`.
+    ///
+    /// precondition: w * h <= s.size
+    void update(texture_2d_array<Pixel>& tex, GLint layer,
+                const staging& s, GLint x, GLint y, GLsizei w, GLsizei h,
+                GLint level = 0)
+    {
+        assert(std::size_t(w) * h <= s.size);
+        scoped_target_buffer_bind bbg(target::target, _stream.id());
+        tex.sub_image(level, layer, x, y, w, h, offset(s));
+        _staged = false;
+    }
+
+    /// Copy `w` * `h` pixels to the ring and update the rectangle at
+    /// (`x`, `y`) of `level` of `layer` of `tex` with them.
+    void update(texture_2d_array<Pixel>& tex, GLint layer,
+                const pixel_type* pixels, GLint x, GLint y, GLsizei w,
+                GLsizei h, GLint level = 0)
+    {
+        update(tex, layer, copy(pixels, std::size_t(w) * h), x, y, w, h,
+               level);
+    }
+
+    /// Mark the end of the updates that read the pixels of the frame.
+    ///
+    /// precondition: the last staging was passed to update()
+    void end_frame()
+    {
+        assert(!_staged && "update() the last staging first");
+        _stream.commit();
+    }
+
+    /// Number of pixels of each frame
+    std::size_t capacity() const noexcept { return _stream.size(); }
+
+    /// Number of times that the ring waited for the GPU
+    std::size_t stalls() const noexcept { return _stream.stalls(); }
+
+    /// Return the buffer's name
+    GLuint id() const noexcept { return _stream.id(); }
+private:
+    stream_buffer<pixel_type, target> _stream;
+    typename stream_buffer<pixel_type, target>::region _region{};
+    std::size_t _used{0};
+    // A staging was returned by stage() and not updated yet
+    bool _staged{false};
+
+    staging copy(const pixel_type* pixels, std::size_t count)
+    {
+        auto s = stage(count);
+        std::copy(pixels, pixels + count, s.data);
+        return s;
+    }
+
+    static const void* offset(const staging& s)
+    { return reinterpret_cast<const void*>(s.first * sizeof(pixel_type)); }
+};
+
+}
@@ -0,0 +1,290 @@
+
+// Copyright Ricardo Calheiros de Miranda Cosme 2017.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "freijo/hash.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/detail/precision.hpp>
+
+namespace freijo {
+
+/// Traits to upload a value of type T to a uniform
+/// (Section 2.11.4 Uniform Variables at OpenGL 3.3 Core Profile)
+///
+/// `upload(program, location, count, values)` calls glUniform*v, or
+/// glProgramUniform*v if FREIJO_DSA is defined. Without DSA the
+/// program must be in use. `type` is the type of the uniform set by
+/// T, e.g. GL_FLOAT_VEC3(see detail::uniform_accepts).
+template<typename T>
+struct UniformTraits;
+
+#ifdef FREIJO_DSA
+#define FREIJO_UNIFORM_UPLOAD(SUFFIX, COMPONENT) \
+    static void upload(GLuint program, GLint location, GLsizei count, \
+                       const void* values) \
+    { \
+        glProgramUniform##SUFFIX( \
+            program, location, count, \
+            static_cast<const COMPONENT*>(values)); \
+    }
+#define FREIJO_UNIFORM_UPLOAD_MATRIX(SUFFIX, COMPONENT) \
+    static void upload(GLuint program, GLint location, GLsizei count, \
+                       const void* values) \
+    { \
+        glProgramUniformMatrix##SUFFIX( \
+            program, location, count, GL_FALSE, \
+            static_cast<const COMPONENT*>(values)); \
+    }
+#else
+#define FREIJO_UNIFORM_UPLOAD(SUFFIX, COMPONENT) \
+    static void upload(GLuint, GLint location, GLsizei count, \
+                       const void* values) \
+    { \
+        glUniform##SUFFIX(location, count, \
+                          static_cast<const COMPONENT*>(values)); \
+    }
+#define FREIJO_UNIFORM_UPLOAD_MATRIX(SUFFIX, COMPONENT) \
+    static void upload(GLuint, GLint location, GLsizei count, \
+                       const void* values) \
+    { \
+        glUniformMatrix##SUFFIX(location, count, GL_FALSE, \
+                                static_cast<const COMPONENT*>(values)); \
+    }
+#endif
+
+#define UniformTraits_SCALAR(T, SUFFIX, TYPE) \
+template<> \
+struct UniformTraits<T> \
+{ \
+    static const GLenum type{TYPE}; \
+    FREIJO_UNIFORM_UPLOAD(SUFFIX, T) \
+};
+
+UniformTraits_SCALAR(GLfloat, 1fv, GL_FLOAT)
+UniformTraits_SCALAR(GLint, 1iv, GL_INT)
+UniformTraits_SCALAR(GLuint, 1uiv, GL_UNSIGNED_INT)
+
+#define UniformTraits_GLM_TVEC(TVEC, T, SUFFIX, TYPE) \
+template<glm::precision P> \
+struct UniformTraits<glm::TVEC<T, P>> \
+{ \
+    static const GLenum type{TYPE}; \
+    FREIJO_UNIFORM_UPLOAD(SUFFIX, T) \
+};
+
+//Support to glm vectors
+UniformTraits_GLM_TVEC(tvec2, GLfloat, 2fv, GL_FLOAT_VEC2)
+UniformTraits_GLM_TVEC(tvec3, GLfloat, 3fv, GL_FLOAT_VEC3)
+UniformTraits_GLM_TVEC(tvec4, GLfloat, 4fv, GL_FLOAT_VEC4)
+UniformTraits_GLM_TVEC(tvec2, GLint, 2iv, GL_INT_VEC2)
+UniformTraits_GLM_TVEC(tvec3, GLint, 3iv, GL_INT_VEC3)
+UniformTraits_GLM_TVEC(tvec4, GLint, 4iv, GL_INT_VEC4)
+UniformTraits_GLM_TVEC(tvec2, GLuint, 2uiv, GL_UNSIGNED_INT_VEC2)
+UniformTraits_GLM_TVEC(tvec3, GLuint, 3uiv, GL_UNSIGNED_INT_VEC3)
+UniformTraits_GLM_TVEC(tvec4, GLuint, 4uiv, GL_UNSIGNED_INT_VEC4)
+
+#define UniformTraits_GLM_TMAT(TMAT, SUFFIX, TYPE) \
+template<glm::precision P> \
+struct UniformTraits<glm::TMAT<GLfloat, P>> \
+{ \
+    static const GLenum type{TYPE}; \
+    FREIJO_UNIFORM_UPLOAD_MATRIX(SUFFIX, GLfloat) \
+};
+
+//Support to glm matrices
+UniformTraits_GLM_TMAT(tmat2x2, 2fv, GL_FLOAT_MAT2)
+UniformTraits_GLM_TMAT(tmat2x3, 2x3fv, GL_FLOAT_MAT2x3)
+UniformTraits_GLM_TMAT(tmat2x4, 2x4fv, GL_FLOAT_MAT2x4)
+UniformTraits_GLM_TMAT(tmat3x2, 3x2fv, GL_FLOAT_MAT3x2)
+UniformTraits_GLM_TMAT(tmat3x3, 3fv, GL_FLOAT_MAT3)
+UniformTraits_GLM_TMAT(tmat3x4, 3x4fv, GL_FLOAT_MAT3x4)
+UniformTraits_GLM_TMAT(tmat4x2, 4x2fv, GL_FLOAT_MAT4x2)
+UniformTraits_GLM_TMAT(tmat4x3, 4x3fv, GL_FLOAT_MAT4x3)
+UniformTraits_GLM_TMAT(tmat4x4, 4fv, GL_FLOAT_MAT4)
+
+namespace detail {
+
+/// Number of bytes of a value of a uniform type
+inline std::size_t uniform_bytes(GLenum type)
+{
+    switch(type)
+    {
+    case GL_FLOAT_VEC2: case GL_INT_VEC2: case GL_UNSIGNED_INT_VEC2:
+    case GL_BOOL_VEC2:
+        return 8;
+    case GL_FLOAT_VEC3: case GL_INT_VEC3: case GL_UNSIGNED_INT_VEC3:
+    case GL_BOOL_VEC3:
+        return 12;
+    case GL_FLOAT_VEC4: case GL_INT_VEC4: case GL_UNSIGNED_INT_VEC4:
+    case GL_BOOL_VEC4: case GL_FLOAT_MAT2:
+        return 16;
+    case GL_FLOAT_MAT2x3: case GL_FLOAT_MAT3x2:
+        return 24;
+    case GL_FLOAT_MAT2x4: case GL_FLOAT_MAT4x2:
+        return 32;
+    case GL_FLOAT_MAT3:
+        return 36;
+    case GL_FLOAT_MAT3x4: case GL_FLOAT_MAT4x3:
+        return 48;
+    case GL_FLOAT_MAT4:
+        return 64;
+#ifdef GL_DOUBLE_VEC2
+    //OpenGL 4.0 or ARB_gpu_shader_fp64
+    case GL_DOUBLE: return 8;
+    case GL_DOUBLE_VEC2: return 16;
+    case GL_DOUBLE_VEC3: return 24;
+    case GL_DOUBLE_VEC4: case GL_DOUBLE_MAT2: return 32;
+    case GL_DOUBLE_MAT2x3: case GL_DOUBLE_MAT3x2: return 48;
+    case GL_DOUBLE_MAT2x4: case GL_DOUBLE_MAT4x2: return 64;
+    case GL_DOUBLE_MAT3: return 72;
+    case GL_DOUBLE_MAT3x4: case GL_DOUBLE_MAT4x3: return 96;
+    case GL_DOUBLE_MAT4: return 128;
+#endif
+    }
+    //Scalars, samplers and images
+    return 4;
+}
+
+/// Return true if a value of the type `value`(see UniformTraits) can
+/// be set to a uniform of the type `uniform`(Section 7.6.1 Loading
+/// Uniform Variables at OpenGL 4.5 Core Profile): the types are the
+/// same, a boolean is set by any type of the same number of
+/// components, and a sampler or an image is set by a GLint.
+inline bool uniform_accepts(GLenum uniform, GLenum value)
+{
+    if(uniform == value) return true;
+    switch(uniform)
+    {
+    case GL_BOOL:
+        return value == GL_FLOAT || value == GL_INT
+            || value == GL_UNSIGNED_INT;
+    case GL_BOOL_VEC2:
+        return value == GL_FLOAT_VEC2 || value == GL_INT_VEC2
+            || value == GL_UNSIGNED_INT_VEC2;
+    case GL_BOOL_VEC3:
+        return value == GL_FLOAT_VEC3 || value == GL_INT_VEC3
+            || value == GL_UNSIGNED_INT_VEC3;
+    case GL_BOOL_VEC4:
+        return value == GL_FLOAT_VEC4 || value == GL_INT_VEC4
+            || value == GL_UNSIGNED_INT_VEC4;
+    case GL_FLOAT: case GL_FLOAT_VEC2: case GL_FLOAT_VEC3:
+    case GL_FLOAT_VEC4: case GL_INT: case GL_INT_VEC2: case GL_INT_VEC3:
+    case GL_INT_VEC4: case GL_UNSIGNED_INT: case GL_UNSIGNED_INT_VEC2:
+    case GL_UNSIGNED_INT_VEC3: case GL_UNSIGNED_INT_VEC4:
+    case GL_FLOAT_MAT2: case GL_FLOAT_MAT3: case GL_FLOAT_MAT4:
+    case GL_FLOAT_MAT2x3: case GL_FLOAT_MAT2x4: case GL_FLOAT_MAT3x2:
+    case GL_FLOAT_MAT3x4: case GL_FLOAT_MAT4x2: case GL_FLOAT_MAT4x3:
+        return false;
+#ifdef GL_DOUBLE_VEC2
+    case GL_DOUBLE: case GL_DOUBLE_VEC2: case GL_DOUBLE_VEC3:
+    case GL_DOUBLE_VEC4: case GL_DOUBLE_MAT2: case GL_DOUBLE_MAT3:
+    case GL_DOUBLE_MAT4: case GL_DOUBLE_MAT2x3: case GL_DOUBLE_MAT2x4:
+    case GL_DOUBLE_MAT3x2: case GL_DOUBLE_MAT3x4: case GL_DOUBLE_MAT4x2:
+    case GL_DOUBLE_MAT4x3:
+        return false;
+#endif
+    }
+    //Samplers and images
+    return value == GL_INT;
+}
+
+/// Active resource of a program: a uniform, an attribute or a
+/// uniform block.
+struct resource
+{
+    std::uint32_t hash{0};
+
+    /// Location of a uniform or an attribute, index of a block
+    GLint location{-1};
+
+    /// Type of a uniform or an attribute
+    GLenum type{0};
+
+    /// Number of elements of an array, size in bytes of a block
+    GLint size{0};
+
+    /// Index of the last value set to a uniform
+    std::size_t shadow{0};
+
+    bool used{false};
+};
+
+/// Flat hash table of resources keyed by the FNV-1a hash of their
+/// names, with open addressing and linear probing. The table is
+/// built once, after the link, and a lookup doesn't call OpenGL.
+class resource_table
+{
+public:
+    /// Prepare the table to receive `count` resources
+    void reserve(std::size_t count)
+    {
+        std::size_t capacity{1};
+        while(capacity < 2 * count) capacity *= 2;
+        _slots.assign(capacity, resource{});
+        _names.assign(capacity, std::string{});
+        _size = 0;
+    }
+
+    /// /throw std::runtime_error if `name` has the same hash of
+    ///        another name
+    void insert(const std::string& name, resource r)
+    {
+        r.hash = fnv1a(name.c_str());
+        r.used = true;
+        auto i = probe(r.hash);
+        if(_slots[i].used)
+            throw std::runtime_error("The resources " + _names[i] + " and "
+                                     + name + " have the same hash");
+        _slots[i] = r;
+        _names[i] = name;
+        ++_size;
+    }
+
+    /// Return the resource with the hash `hash` or nullptr
+    const resource* find(std::uint32_t hash) const noexcept
+    {
+        if(_slots.empty()) return nullptr;
+        auto& r = _slots[probe(hash)];
+        return r.used ? &r : nullptr;
+    }
+
+    /// Return the resource named `name` or nullptr
+    const resource* find(const char* name) const noexcept
+    {
+        if(_slots.empty()) return nullptr;
+        auto i = probe(fnv1a(name));
+        return _slots[i].used && _names[i] == name ? &_slots[i] : nullptr;
+    }
+
+    /// Number of resources
+    std::size_t size() const noexcept { return _size; }
+private:
+    std::vector<resource> _slots;
+    std::vector<std::string> _names;
+    std::size_t _size{0};
+
+    // Slot of `hash` or the empty slot where it would be
+    std::size_t probe(std::uint32_t hash) const noexcept
+    {
+        auto mask = _slots.size() - 1;
+        auto i = hash & mask;
+        while(_slots[i].used && _slots[i].hash != hash)
+            i = (i + 1) & mask;
+        return i;
+    }
+};
+
+}
+
+}
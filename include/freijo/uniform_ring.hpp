@@ -0,0 +1,123 @@
+
+// Copyright Ricardo Calheiros de Miranda Cosme 2017.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "freijo/buffer.hpp"
+#include "freijo/state.hpp"
+#include "freijo/stream_buffer.hpp"
+
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+
+namespace freijo {
+
+namespace detail {
+
+// GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT of the current context
+inline std::size_t uniform_offset_alignment()
+{
+    GLint alignment{0};
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    assert(alignment > 0);
+    return alignment;
+}
+
+}
+
+/// Ring of uniform blocks rewritten every frame, e.g. the per-draw
+/// constants (model matrix, material, ...).
+///
+/// The blocks are written to a persistent mapped stream_buffer and
+/// each one is bound with glBindBufferRange, so a block costs one
+/// memcpy and one range bind instead of a glBufferSubData and a
+/// synchronization with the driver. The blocks are placed with a
+/// stride of sizeof(T) rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT.
+///
+/// Example:
+///
+///   freijo::uniform_ring<Object> objects(1024);
+///   ...
+///   objects.begin_frame();
+///   for(auto& o : scene)
+///   {
+///       objects.push(1, o.constants); //layout(binding = 1)
+///       freijo::draw_elements(GL_TRIANGLES, o.vao, o.ebo);
+///   }
+///   objects.end_frame();
+///
+/// /tparam T Type of the block, it must match the std140 layout
+///           (see UniformBuffer).
+///
+/// Model the concept Movable.
+///
+template<typename T>
+class uniform_ring
+{
+public:
+    using value_type = T;
+    using target = UniformBuffer<T>;
+
+    /// /param capacity Number of blocks of each frame. A frame with
+    ///                 more blocks waits for the GPU to reuse the
+    ///                 next region.
+    /// /param regions Number of frames in the ring.
+    explicit uniform_ring(std::size_t capacity, std::size_t regions = 3)
+        : _stride(stride_of(detail::uniform_offset_alignment()))
+        , _stream(capacity * _stride, regions)
+    {}
+
+    /// Start writing the blocks of a frame.
+    void begin_frame()
+    {
+        _region = _stream.next();
+        _used = 0;
+    }
+
+    /// Copy `block` to the ring and bind it to the uniform block
+    /// binding point `index`.
+    void push(GLuint index, const value_type& block)
+    {
+        if(_used + _stride > _region.size)
+        {
+            _stream.commit();
+            begin_frame();
+        }
+        std::memcpy(_region.data + _used, &block, sizeof(value_type));
+        state().bind_buffer_range(GL_UNIFORM_BUFFER, index, _stream.id(),
+                                  _region.offset() + _used,
+                                  sizeof(value_type));
+        _used += _stride;
+    }
+
+    /// Mark the end of the commands that read the blocks of the frame.
+    void end_frame()
+    { _stream.commit(); }
+
+    /// Distance in bytes between two blocks
+    std::size_t stride() const noexcept { return _stride; }
+
+    /// Number of blocks of each frame
+    std::size_t capacity() const noexcept
+    { return _stream.size() / _stride; }
+
+    /// Number of times that the ring waited for the GPU
+    std::size_t stalls() const noexcept { return _stream.stalls(); }
+
+    /// Return the buffer's name
+    GLuint id() const noexcept { return _stream.id(); }
+private:
+    std::size_t _stride;
+    stream_buffer<GLubyte, target> _stream;
+    typename stream_buffer<GLubyte, target>::region _region{};
+    std::size_t _used{0};
+
+    static std::size_t stride_of(std::size_t alignment)
+    { return detail::align_up(sizeof(value_type), alignment); }
+};
+
+}
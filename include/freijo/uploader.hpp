@@ -0,0 +1,350 @@
+
+// Copyright Ricardo Calheiros de Miranda Cosme 2017.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "freijo/buffer.hpp"
+#include "freijo/fence.hpp"
+#include "freijo/state.hpp"
+
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace freijo {
+
+namespace detail {
+
+// Value of an upload issued by the uploader: the fence after the
+// upload and the buffer written
+struct issued_upload
+{
+    fence sync;
+    GLuint id;
+};
+
+}
+
+/// Upload issued by an uploader
+///
+/// The upload is ready when the worker has issued it and inserted a
+/// fence after it. wait_server() makes the GPU of the current context
+/// wait for the fence(glWaitSync), so the client only blocks until the
+/// upload is issued, not until it's completed.
+///
+/// Model the concept Movable.
+///
+class pending_upload
+{
+public:
+    pending_upload() = default;
+
+    explicit pending_upload(std::future<detail::issued_upload> issued)
+        : _issued(std::move(issued))
+    {}
+
+    /// Return true if the worker has issued the upload. It never
+    /// blocks.
+    bool ready() const
+    {
+        return !_issued.valid()
+            || _issued.wait_for(std::chrono::seconds(0))
+               == std::future_status::ready;
+    }
+
+    /// Make the GPU wait for the upload before the next commands of the
+    /// current context. It must be called before the first draw that
+    /// reads the buffer.
+    ///
+    /// Section 5.3 Propagating Changes to Objects at OpenGL 4.5 Core
+    /// Profile: the buffer is bound again, to a scratch target, so its
+    /// new contents are visible in the current context.
+    ///
+    /// /throw the exception of the upload, if it failed
+    void wait_server()
+    {
+        if(!take()) return;
+        _result.sync.wait_server();
+        state().bind_buffer(GL_COPY_READ_BUFFER, 0);
+        state().bind_buffer(GL_COPY_READ_BUFFER, _result.id);
+    }
+
+    /// Block the client until the GPU completes the upload.
+    ///
+    /// /throw the exception of the upload, if it failed
+    void wait()
+    {
+        take();
+        _result.sync.wait();
+    }
+private:
+    std::future<detail::issued_upload> _issued;
+    detail::issued_upload _result{fence{}, 0};
+
+    // Return false if the result was already taken
+    bool take()
+    {
+        if(!_issued.valid()) return false;
+        _result = _issued.get();
+        return true;
+    }
+};
+
+/// Buffer created by an uploader
+///
+/// Model the concept Movable.
+///
+template<typename Buffer>
+class pending_buffer : public pending_upload
+{
+public:
+    pending_buffer() = default;
+
+    pending_buffer(std::future<detail::issued_upload> issued,
+                   std::shared_ptr<Buffer> slot)
+        : pending_upload(std::move(issued))
+        , _slot(std::move(slot))
+    {}
+
+    /// Make the GPU wait for the upload(see wait_server()) and return
+    /// the buffer. It must be called only once.
+    ///
+    /// /throw the exception of the upload, if it failed
+    Buffer get()
+    {
+        wait_server();
+        return std::move(*_slot);
+    }
+private:
+    std::shared_ptr<Buffer> _slot;
+};
+
+/// Thread that uploads data to buffers on its own OpenGL context
+///
+/// The context of the thread must share the objects with the context
+/// of the caller(e.g. the `share` argument of eglCreateContext or
+/// glfwCreateWindow). The uploader doesn't create contexts: the thread
+/// calls `make_current` when it starts and `release` before it
+/// finishes, e.g.
+///
+///   auto loader = glfwCreateWindow(1, 1, "", nullptr, window); //hidden
+///   freijo::uploader up([=]{ glfwMakeContextCurrent(loader); },
+///                       []{ glfwMakeContextCurrent(nullptr); });
+///
+/// create() allocates and fills a new buffer on the thread, and
+/// upload() writes to an existing buffer, so the caller doesn't block
+/// during the allocation nor the transfer:
+///
+///   auto pending = up.create<Vertex>(std::move(vertices));
+///   ...
+///   if(pending.ready())
+///   {
+///       auto vbo = pending.get(); //the GPU waits, not the client
+///       vao.attach(0, vbo);
+///       freijo::draw_arrays(GL_TRIANGLES, vao, vbo);
+///   }
+///
+/// The jobs are executed in order. The buffer of upload() must live
+/// until the upload is ready.
+///
+class uploader
+{
+public:
+    /// Start the thread
+    ///
+    /// /param make_current Make the shared context current in the
+    ///                     calling thread.
+    /// /param release Release the context from the calling thread.
+    explicit uploader(std::function<void()> make_current,
+                      std::function<void()> release = {})
+        : _make_current(std::move(make_current))
+        , _release(std::move(release))
+        , _thread(&uploader::run, this)
+    {}
+
+    /// Finish the queued jobs and stop the thread
+    ~uploader()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _cv.notify_one();
+        _thread.join();
+    }
+
+    uploader(const uploader&) = delete;
+    uploader& operator=(const uploader&) = delete;
+
+    /// Allocate a buffer with `data` on the thread. The vector is
+    /// moved to the job and released after the upload.
+    ///
+    /// /throw std::runtime_error from get() if the allocation failed
+    template<typename T, typename Target = ArrayBuffer<T>>
+    pending_buffer<buffer<T, Target>> create(std::vector<T> data,
+                                             GLenum usage = GL_STATIC_DRAW)
+    {
+        using buffer_type = buffer<T, Target>;
+        auto owner = std::make_shared<std::vector<T>>(std::move(data));
+        auto slot = std::make_shared<buffer_type>();
+        auto issued = push([owner, slot, usage]
+        {
+            *slot = buffer_type(make_view(owner->data(), owner->size()),
+                                usage);
+            if(glGetError() != GL_NO_ERROR)
+                throw std::runtime_error("Failed to allocate the buffer");
+            return slot->id();
+        });
+        return pending_buffer<buffer_type>(std::move(issued), slot);
+    }
+
+    /// Write `data` to `buf` starting at the element `offset`. The
+    /// vector is moved to the job and released after the upload.
+    ///
+    /// precondition: offset + data.size() <= buf.size()
+    template<typename Buffer>
+    pending_upload upload(const Buffer& buf,
+                          std::vector<typename Buffer::value_type> data,
+                          std::size_t offset = 0)
+    {
+        using value_type = typename Buffer::value_type;
+        assert(offset + data.size() <= buf.size());
+        auto owner = std::make_shared<std::vector<value_type>>
+            (std::move(data));
+        // The storage of the buffer must be complete before the other
+        // context writes to it.
+        glFlush();
+        GLuint id = buf.id();
+        return pending_upload(push([owner, id, offset]
+        {
+            write(id, offset * sizeof(value_type), owner->data(),
+                  owner->size() * sizeof(value_type));
+            return id;
+        }));
+    }
+
+    /// Write `data` to `buf` starting at the element `offset`. The
+    /// elements aren't copied, they must live until the upload is
+    /// ready.
+    ///
+    /// precondition: offset + data.size <= buf.size()
+    template<typename Buffer>
+    pending_upload upload(const Buffer& buf,
+                          view<typename Buffer::value_type> data,
+                          std::size_t offset = 0)
+    {
+        using value_type = typename Buffer::value_type;
+        assert(offset + data.size <= buf.size());
+        glFlush();
+        GLuint id = buf.id();
+        return pending_upload(push([data, id, offset]
+        {
+            write(id, offset * sizeof(value_type), data.data,
+                  data.size * sizeof(value_type));
+            return id;
+        }));
+    }
+
+    /// Number of jobs that weren't issued yet
+    std::size_t pending() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _jobs.size() + _running;
+    }
+private:
+    struct job
+    {
+        // Issue the upload and return the name of the buffer
+        std::function<GLuint()> work;
+        std::promise<detail::issued_upload> issued;
+    };
+
+    std::function<void()> _make_current;
+    std::function<void()> _release;
+    mutable std::mutex _mutex;
+    std::condition_variable _cv;
+    std::deque<job> _jobs;
+    std::size_t _running{0};
+    bool _stop{false};
+    std::thread _thread;
+
+    std::future<detail::issued_upload> push(std::function<GLuint()> work)
+    {
+        std::promise<detail::issued_upload> issued;
+        auto future = issued.get_future();
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _jobs.push_back(job{std::move(work), std::move(issued)});
+        }
+        _cv.notify_one();
+        return future;
+    }
+
+    void run()
+    {
+        _make_current();
+        for(;;)
+        {
+            job j;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _cv.wait(lock, [this]{ return _stop || !_jobs.empty(); });
+                if(_jobs.empty()) break;
+                j = std::move(_jobs.front());
+                _jobs.pop_front();
+                _running = 1;
+            }
+            detail::issued_upload result{fence{}, 0};
+            std::exception_ptr error;
+            try
+            {
+                result.id = j.work();
+                result.sync.set();
+                // The fence must reach the GPU before another context
+                // waits for it.
+                glFlush();
+            }
+            catch(...)
+            { error = std::current_exception(); }
+            j.work = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _running = 0;
+            }
+            if(error)
+                j.issued.set_exception(error);
+            else
+                j.issued.set_value(std::move(result));
+        }
+        if(_release) _release();
+    }
+
+    static void write(GLuint id, std::size_t offset, const void* data,
+                      std::size_t bytes)
+    {
+#ifdef FREIJO_DSA
+        glNamedBufferSubData(id, offset, bytes, data);
+#else
+        scoped_target_buffer_bind bbg(GL_COPY_WRITE_BUFFER, id);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, offset, bytes, data);
+#endif
+        if(glGetError() != GL_NO_ERROR)
+            throw std::runtime_error("Failed to upload to the buffer");
+    }
+};
+
+}
@@ -0,0 +1,336 @@
+
+// Copyright Ricardo Calheiros de Miranda Cosme 2017.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "freijo/VAO.hpp"
+#include "freijo/buffer.hpp"
+#include "freijo/state.hpp"
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+
+namespace freijo {
+
+/// Stream of a vertex_format that advances once every `Divisor`
+/// instances instead of once per vertex
+template<typename T, GLuint Divisor = 1>
+struct per_instance {};
+
+namespace detail {
+
+template<typename Stream>
+struct stream_traits
+{
+    using type = Stream;
+    static const GLuint divisor = 0;
+};
+
+template<typename T, GLuint Divisor>
+struct stream_traits<per_instance<T, Divisor>>
+{
+    using type = T;
+    static const GLuint divisor = Divisor;
+};
+
+template<typename... Attribs>
+struct attribs_columns : std::integral_constant<GLuint, 0> {};
+
+template<typename A, typename... Attribs>
+struct attribs_columns<A, Attribs...>
+    : std::integral_constant<GLuint,
+        A::columns + attribs_columns<Attribs...>::value> {};
+
+template<typename Tuple>
+struct tuple_columns;
+
+template<typename... Attribs>
+struct tuple_columns<std::tuple<Attribs...>> : attribs_columns<Attribs...> {};
+
+// Number of attribute locations used by a stream of T
+template<typename T, bool Interleaved = is_interleaved<T>::value>
+struct stream_locations
+    : std::integral_constant<GLuint, VertexTraits<T>::columns> {};
+
+template<typename T>
+struct stream_locations<T, true>
+    : tuple_columns<typename VertexLayout<T>::attribs> {};
+
+// precondition: without FREIJO_DSA the VAO is bound
+inline void attrib_format(GLuint vao, GLuint location, GLuint binding,
+                          GLint size, GLenum type, GLboolean normalized,
+                          GLuint offset)
+{
+#ifdef FREIJO_DSA
+    glVertexArrayAttribFormat(vao, location, size, type, normalized, offset);
+    glVertexArrayAttribBinding(vao, location, binding);
+    glEnableVertexArrayAttrib(vao, location);
+#else
+    (void)vao;
+    glVertexAttribFormat(location, size, type, normalized, offset);
+    glVertexAttribBinding(location, binding);
+    glEnableVertexAttribArray(location);
+#endif
+}
+
+template<typename T, bool Interleaved = is_interleaved<T>::value>
+struct stream_format
+{
+    static void apply(GLuint vao, GLuint binding, GLuint location)
+    {
+        using format = vertex_format<T>;
+        const GLuint column = sizeof(T) / format::columns;
+        for(GLint c{0}; c < format::columns; ++c)
+            attrib_format(vao, location + c, binding, format::size,
+                          format::type, format::normalized, c * column);
+    }
+};
+
+template<typename T>
+struct stream_format<T, true>
+{
+    static void apply(GLuint vao, GLuint binding, GLuint location)
+    { attribs(vao, binding, location,
+              static_cast<typename VertexLayout<T>::attribs*>(nullptr)); }
+
+    template<typename... Attribs>
+    static void attribs(GLuint vao, GLuint binding, GLuint location,
+                        std::tuple<Attribs...>*)
+    {
+        int expand[] = {0, (attrib<Attribs>(vao, binding, location),
+                            location += Attribs::columns, 0)...};
+        (void)expand;
+    }
+
+    template<typename Attrib>
+    static void attrib(GLuint vao, GLuint binding, GLuint location)
+    {
+        const GLuint column = sizeof(typename Attrib::type) / Attrib::columns;
+        for(GLint c{0}; c < Attrib::columns; ++c)
+            attrib_format(vao, location + c, binding, Attrib::size,
+                          Attrib::gltype, Attrib::normalized,
+                          Attrib::offset + c * column);
+    }
+};
+
+// Formats of the streams starting at `Binding` and `Location`
+template<GLuint Binding, GLuint Location, typename... Streams>
+struct streams_format
+{
+    static void apply(GLuint) {}
+};
+
+template<GLuint Binding, GLuint Location, typename S, typename... Streams>
+struct streams_format<Binding, Location, S, Streams...>
+{
+    static void apply(GLuint vao)
+    {
+        using type = typename stream_traits<S>::type;
+        stream_format<type>::apply(vao, Binding, Location);
+#ifdef FREIJO_DSA
+        glVertexArrayBindingDivisor(vao, Binding, stream_traits<S>::divisor);
+#else
+        glVertexBindingDivisor(Binding, stream_traits<S>::divisor);
+#endif
+        streams_format<Binding + 1,
+                       Location + stream_locations<type>::value,
+                       Streams...>::apply(vao);
+    }
+};
+
+template<typename T>
+struct type_key { static char id; };
+
+template<typename T>
+char type_key<T>::id;
+
+}
+
+/// VAO with a fixed vertex format whose buffers are switched with one
+/// call (Section 10.3.1 Specifying Arrays for Generic Vertex
+/// Attributes at OpenGL 4.5 Core Profile, OpenGL 4.3 or
+/// ARB_vertex_attrib_binding)
+///
+/// The format of the attributes(glVertexAttribFormat) and their
+/// binding points(glVertexAttribBinding) are set once at
+/// construction. Each stream is a binding point: stream `i` reads the
+/// buffer bound by bind_buffers() or bind_buffer<i>()
+/// (glBindVertexBuffer). So one VAO per layout serves all the meshes of
+/// that layout, while VAO::attach repeats every attribute call for
+/// each buffer.
+///
+/// The attributes take consecutive locations starting at 0: a stream
+/// of an interleaved vertex(see VertexLayout) takes one location per
+/// attribute and a matrix takes one location per column.
+///
+/// Example:
+///
+///   freijo::vertex_format<Vertex, freijo::per_instance<glm::mat4>> format;
+///   for(auto& mesh : meshes)
+///   {
+///       format.bind_buffers(mesh.vertices, mesh.transforms);
+///       format.bind_elements(mesh.indices);
+///       freijo::draw_elements_instanced(GL_TRIANGLES, format.vao(),
+///                                       mesh.indices,
+///                                       mesh.transforms.size());
+///   }
+///
+/// /tparam Streams Type of the vertex of each stream, or
+///                 per_instance<T, Divisor>.
+///
+/// Model the concept Movable.
+///
+template<typename... Streams>
+class vertex_format
+{
+public:
+    static const std::size_t streams = sizeof...(Streams);
+
+    /// Type of the vertex of the stream `Binding`
+    template<std::size_t Binding>
+    using stream_type = typename std::tuple_element<
+        Binding,
+        std::tuple<typename detail::stream_traits<Streams>::type...>>::type;
+
+    vertex_format()
+    {
+#ifndef FREIJO_DSA
+        scoped_vao_bind sb(_vao);
+#endif
+        detail::streams_format<0, 0, Streams...>::apply(_vao.id());
+    }
+
+    vertex_format(vertex_format&&) = default;
+    vertex_format& operator=(vertex_format&&) = default;
+
+    /// Bind `vbo` to the stream `Binding`, starting at the byte
+    /// `offset`. Without FREIJO_DSA the VAO is left bound.
+    template<std::size_t Binding, typename VBO>
+    void bind_buffer(const VBO& vbo, GLintptr offset = 0) const
+    {
+        static_assert(Binding < streams, "There isn't such stream");
+        static_assert(std::is_same<typename VBO::value_type,
+                                   stream_type<Binding>>::value,
+                      "The type of the buffer doesn't match the stream");
+#ifdef FREIJO_DSA
+        glVertexArrayVertexBuffer(_vao.id(), Binding, vbo.id(), offset,
+                                  sizeof(stream_type<Binding>));
+#else
+        _vao.bind();
+        glBindVertexBuffer(Binding, vbo.id(), offset,
+                           sizeof(stream_type<Binding>));
+#endif
+    }
+
+    /// Bind one buffer to each stream, in the order of the streams,
+    /// with a single call on OpenGL 4.4(glBindVertexBuffers), one
+    /// glBindVertexBuffer per stream on an older context. Without
+    /// FREIJO_DSA the VAO is left bound.
+    template<typename... VBOs>
+    void bind_buffers(const VBOs&... vbos) const
+    {
+        static_assert(sizeof...(VBOs) == streams,
+                      "One buffer per stream is required");
+        static_assert(
+            std::is_same<std::tuple<typename VBOs::value_type...>,
+                         std::tuple<typename detail::stream_traits<
+                             Streams>::type...>>::value,
+            "The types of the buffers don't match the streams");
+        const std::array<GLuint, streams> ids{{vbos.id()...}};
+        const std::array<GLintptr, streams> offsets{};
+        const std::array<GLsizei, streams> strides{{
+            static_cast<GLsizei>(sizeof(typename VBOs::value_type))...}};
+#ifdef FREIJO_DSA
+        glVertexArrayVertexBuffers(_vao.id(), 0, streams, ids.data(),
+                                   offsets.data(), strides.data());
+#else
+        _vao.bind();
+        // glBindVertexBuffers is OpenGL 4.4: it isn't declared by an
+        // older loader and the pointer is null in an older context.
+#ifdef GL_VERSION_4_4
+        if(state().version() >= 44)
+        {
+            glBindVertexBuffers(0, streams, ids.data(), offsets.data(),
+                                strides.data());
+            return;
+        }
+#endif
+        for(std::size_t i{0}; i < streams; ++i)
+            glBindVertexBuffer(i, ids[i], offsets[i], strides[i]);
+#endif
+    }
+
+    /// Attach the element buffer `ebo`(see VAO::attach)
+    template<typename EBO>
+    void bind_elements(const EBO& ebo) const
+    { _vao.attach(ebo); }
+
+    void bind() const { _vao.bind(); }
+    void unbind() const { _vao.unbind(); }
+
+    /// VAO for the draw calls(see draw.hpp)
+    const VAO& vao() const noexcept { return _vao; }
+
+    GLuint id() const noexcept { return _vao.id(); }
+private:
+    VAO _vao;
+};
+
+/// Cache of vertex formats: one shared VAO for each distinct
+/// compile-time layout
+///
+/// The VAOs belong to the current context, so the cache must be
+/// destroyed before the context.
+///
+/// Example:
+///
+///   freijo::vertex_format_cache formats;
+///   auto& format = formats.get<Vertex>(); //the same VAO for all the
+///                                         //meshes of Vertex
+///   format.bind_buffers(mesh.vertices);
+///
+class vertex_format_cache
+{
+public:
+    vertex_format_cache() = default;
+    vertex_format_cache(const vertex_format_cache&) = delete;
+    vertex_format_cache& operator=(const vertex_format_cache&) = delete;
+
+    /// Return the vertex format of `Streams`, created on the first call
+    template<typename... Streams>
+    vertex_format<Streams...>& get()
+    {
+        using format = vertex_format<Streams...>;
+        auto& slot = _formats[&detail::type_key<format>::id];
+        if(!slot) slot.reset(new holder<format>);
+        return static_cast<holder<format>&>(*slot).value;
+    }
+
+    /// Number of vertex formats
+    std::size_t size() const noexcept { return _formats.size(); }
+
+    /// Delete all the vertex formats
+    void clear() { _formats.clear(); }
+private:
+    struct holder_base
+    {
+        virtual ~holder_base() = default;
+    };
+
+    template<typename T>
+    struct holder : holder_base
+    {
+        T value;
+    };
+
+    std::unordered_map<const void*, std::unique_ptr<holder_base>> _formats;
+};
+
+}